@@ -0,0 +1,107 @@
+#!/bin/bash
+#
+# Time slurm_topology and ibgraphfabric over synthetic fabrics written by
+# ibfabricgen.pl.  Each fabric is generated once and kept in the bench
+# directory; the --stats output of every run is kept there as well.
+#
+
+bench_dir=bench
+bin_dir=src
+gen=`dirname $0`/ibfabricgen.pl
+
+# ~2K to ~200K nodes
+default_fabrics="ftree:12,3 tapered:64,24,8,8 torus:8,8,8,4 dragonfly:33,8,8,4
+	ftree:18,3 tapered:240,32,16,16 dragonfly:129,16,8,8 torus:16,16,16,8
+	ftree:20,4 dragonfly:257,16,48,16"
+
+usage()
+{
+	echo "ibfabricbench.sh [-h] [-d <dir>] [-b <bin_dir>] [-g <generator>]"
+	echo "                 [<topology> ...]"
+	echo "   Time slurm_topology and ibgraphfabric over synthetic fabrics."
+	echo "   -h display this help"
+	echo "   -d <dir> keep fabrics and results here (default: $bench_dir)"
+	echo "   -b <bin_dir> directory holding the tools (default: $bin_dir)"
+	echo "   -g <generator> path to ibfabricgen.pl (default: $gen)"
+	echo "   <topology> as for ibfabricgen.pl -t (default: a corpus of"
+	echo "              fat tree, tapered, dragonfly and torus fabrics)"
+}
+
+while getopts "hd:b:g:" opt; do
+	case $opt in
+		d) bench_dir=$OPTARG ;;
+		b) bin_dir=$OPTARG ;;
+		g) gen=$OPTARG ;;
+		h) usage; exit 0 ;;
+		*) usage; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+fabrics="$*"
+if [ "$fabrics" == "" ]; then
+	fabrics=$default_fabrics
+fi
+
+for tool in slurm_topology ibgraphfabric; do
+	if [ ! -x $bin_dir/$tool ]; then
+		echo "ERROR: $bin_dir/$tool not found; build it first" 1>&2
+		exit 1
+	fi
+done
+
+mkdir -p $bench_dir || exit 1
+
+now()
+{
+	date +%s.%N
+}
+
+# run_tool <name> <results> <cmd ...>; a failed run sets rc
+run_tool()
+{
+	local name=$1
+	local results=$2
+	local trc start end secs
+	shift 2
+
+	start=`now`
+	"$@" > /dev/null 2> $results
+	trc=$?
+	end=`now`
+
+	if [ $trc != 0 ]; then
+		secs="FAILED($trc)"
+		rc=1
+	else
+		secs=`echo "$start $end" | awk '{ printf "%.3f", $2 - $1 }'`
+	fi
+	printf "%-28s %8s %-16s %12s\n" $fabric $nodes $name $secs
+}
+
+rc=0
+printf "%-28s %8s %-16s %12s\n" "fabric" "nodes" "tool" "seconds"
+for fabric in $fabrics; do
+	base=$bench_dir/`echo $fabric | tr ':,' '__'`
+
+	if [ ! -f $base.cache ]; then
+		if ! perl $gen -t $fabric -o $base.cache -m $base.map \
+				-H $base.hosts 2> $base.gen; then
+			cat $base.gen 1>&2
+			rm -f $base.cache
+			rc=1
+			continue
+		fi
+	fi
+	nodes=`grep -c '^0x' $base.map`
+
+	run_tool slurm_topology $base.slurm_topology.stats \
+		$bin_dir/slurm_topology --load-cache $base.cache \
+			--node-name-map $base.map --hosts "`cat $base.hosts`" \
+			--stats -o -
+	run_tool ibgraphfabric $base.ibgraphfabric.stats \
+		$bin_dir/ibgraphfabric --load-cache $base.cache \
+			--node-name-map $base.map --stats
+done
+
+exit $rc
@@ -0,0 +1,518 @@
+#!/usr/bin/perl
+#################################################################################
+#
+#  Copyright (C) 2011 Lawrence Livermore National Security
+#  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+#  UCRL-CODE-235440
+#
+#  This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+#  Infiniband Clusters.
+#  For details, see http://www.llnl.gov/linux/.
+#
+#  PIU is free software; you can redistribute it
+#  and/or modify it under the terms of the GNU General Public License as
+#  published by the Free Software Foundation; either version 2 of the License,
+#  or (at your option) any later version.
+#
+#  PIU is distributed in the hope that it will be
+#  useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+#  Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License along with
+#  PIU; if not, write to the Free Software
+#  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+#
+#################################################################################
+#
+# Generate a synthetic fabric in the format of "ibnetdiscover --cache" so
+# slurm_topology and ibgraphfabric can be run (--load-cache) against large
+# fabrics without a fabric.  Optionally write a node name map for it and the
+# list of hosts (for slurm_topology --hosts).
+#
+#################################################################################
+
+use strict;
+
+use Getopt::Std;
+
+# ibnetdisc cache format (version 1), as ibnetdisc_cache.c writes it: the
+# header, node and port fields are little endian; the NodeInfo, SwitchInfo
+# and PortInfo SMP data is stored as read off the wire (big endian)
+my $CACHE_MAGIC   = 0x8FE7832B;
+my $CACHE_VERSION = 1;
+my $SMP_DATA_SIZE = 64;
+
+my $NODE_CA     = 1;
+my $NODE_SWITCH = 2;
+
+my $SW_GUID_BASE = 0x0002c90200000000;
+my $CA_GUID_BASE = 0x0002c90300000000;
+
+# hostlist limits a single range to 16K hosts
+my $HOSTS_PER_RANGE = 16384;
+
+my $host_prefix = "node";
+my $width       = 2;    # 4x
+my $speed       = 4;    # QDR
+
+# nodes; indexed by node number
+my @type     = ();
+my @numports = ();
+my @name     = ();
+my @desc     = ();
+my @guid     = ();
+my @lid      = ();
+# remote end of each port; $peer[$n][$p] = [ $rem_node, $rem_port ]
+my @peer = ();
+
+my $num_hosts    = 0;
+my $num_switches = 0;
+
+sub usage
+{
+	my $prog = `basename $0`;
+
+	chomp($prog);
+	print "Usage: $prog -t <topology> -o <cache_file> [-m <node_name_map>]\n";
+	print "       [-H <hosts_file>] [-p <host_prefix>] [-l <link_rate>]\n";
+	print "  -t <topology> one of:\n";
+	print "       ftree:<k>,<n>            k-ary n-tree; k^n hosts and n levels\n";
+	print "                                of k^(n-1) 2k port switches\n";
+	print "       tapered:<L>,<H>,<U>,<S>  L leaf switches of H hosts, each with\n";
+	print "                                U uplinks spread over S spine switches\n";
+	print "       dragonfly:<g>,<a>,<p>,<h> g groups of a switches of p hosts;\n";
+	print "                                switches in a group are all connected\n";
+	print "                                and each has h links to other groups\n";
+	print "       torus:<X>,<Y>,<Z>,<p>    3D torus of switches with p hosts each\n";
+	print "  -o <cache_file> write the fabric here\n";
+	print "  -m <node_name_map> also write a node name map for the fabric\n";
+	print "  -H <hosts_file> also write the list of hosts in hostlist format\n";
+	print "  -p <host_prefix> prefix of host names (default \"$host_prefix\")\n";
+	print "  -l <link_rate> rate of every link, e.g. 4xQDR (default), 12xDDR\n";
+	print "\n";
+	print "  LIDs are reused past 48K nodes; the tools do not depend on them.\n";
+	exit 2;
+}
+
+sub add_node
+{
+	my ($type, $numports, $name, $desc, $guid) = @_;
+	my $n = scalar(@type);
+
+	if ($numports > 254) {
+		die "ERROR: $name would need $numports ports\n";
+	}
+	push(@type,     $type);
+	push(@numports, $numports);
+	push(@name,     $name);
+	push(@desc,     $desc);
+	push(@guid,     $guid);
+	push(@lid,      ($n % 0xBFFF) + 1);
+	push(@peer,     []);
+	return $n;
+}
+
+sub add_host
+{
+	$num_hosts++;
+	my $name = "$host_prefix$num_hosts";
+	return add_node($NODE_CA, 1, $name, "$name HCA-1",
+			$CA_GUID_BASE + 2 * $num_hosts);
+}
+
+sub add_switch
+{
+	my ($numports, $name) = @_;
+
+	$num_switches++;
+	return add_node($NODE_SWITCH, $numports, $name, "MF0;$name:IS5030/U1",
+			$SW_GUID_BASE + $num_switches);
+}
+
+sub connect_ports
+{
+	my ($n1, $p1, $n2, $p2) = @_;
+
+	if ($p1 > $numports[$n1] || $p2 > $numports[$n2]) {
+		die "ERROR: $name[$n1]/$p1 -> $name[$n2]/$p2 out of range\n";
+	}
+	if (defined($peer[$n1][$p1]) || defined($peer[$n2][$p2])) {
+		die "ERROR: $name[$n1]/$p1 -> $name[$n2]/$p2 already connected\n";
+	}
+	$peer[$n1][$p1] = [ $n2, $p2 ];
+	$peer[$n2][$p2] = [ $n1, $p1 ];
+}
+
+#
+# Topologies
+#
+
+# k-ary n-tree: switch w at level l reaches the switches at level l+1 which
+# differ from w only in digit l-1 (base k)
+sub gen_ftree
+{
+	my ($k, $n) = @_;
+	my $per_level = $k**($n - 1);
+	my @level_names = ("ibleaf", "ibspine", "ibcore");
+	my @sw = ();
+	my ($l, $w, $d, $u);
+
+	for ($l = 1; $l <= $n; $l++) {
+		my $prefix = $l <= 3 ? $level_names[$l - 1] : "ibtop";
+		my $first = $l <= 3 ? 0 : ($l - 4) * $per_level;
+		for ($w = 0; $w < $per_level; $w++) {
+			$sw[$l][$w] = add_switch(2 * $k, $prefix . ($first + $w + 1));
+		}
+	}
+
+	for ($w = 0; $w < $per_level; $w++) {
+		for ($d = 0; $d < $k; $d++) {
+			connect_ports($sw[1][$w], $d + 1, add_host(), 1);
+		}
+	}
+
+	for ($l = 1; $l < $n; $l++) {
+		my $div = $k**($l - 1);
+		for ($w = 0; $w < $per_level; $w++) {
+			my $digit = int($w / $div) % $k;
+			for ($u = 0; $u < $k; $u++) {
+				my $up = $w + ($u - $digit) * $div;
+				connect_ports($sw[$l][$w], $k + 1 + $u,
+					      $sw[$l + 1][$up], $digit + 1);
+			}
+		}
+	}
+}
+
+# two levels; U < H makes a tapered (oversubscribed) tree
+sub gen_tapered
+{
+	my ($leaves, $hosts, $uplinks, $spines) = @_;
+	my $spine_ports = int(($leaves * $uplinks + $spines - 1) / $spines);
+	my @next_port = ();
+	my @spine = ();
+	my ($i, $h, $u);
+
+	for ($i = 0; $i < $spines; $i++) {
+		$spine[$i] = add_switch($spine_ports, "ibspine" . ($i + 1));
+		$next_port[$i] = 1;
+	}
+	for ($i = 0; $i < $leaves; $i++) {
+		my $leaf = add_switch($hosts + $uplinks, "ibleaf" . ($i + 1));
+		for ($h = 0; $h < $hosts; $h++) {
+			connect_ports($leaf, $h + 1, add_host(), 1);
+		}
+		for ($u = 0; $u < $uplinks; $u++) {
+			my $s = $u % $spines;
+			connect_ports($leaf, $hosts + 1 + $u,
+				      $spine[$s], $next_port[$s]++);
+		}
+	}
+}
+
+# one global link between each pair of groups; group i uses slot j-1 (j > i)
+# or j (j < i) for group j; slot s is on switch s % per_group
+sub gen_dragonfly
+{
+	my ($groups, $per_group, $hosts, $global) = @_;
+	my $local_base = $hosts;
+	my $global_base = $hosts + $per_group - 1;
+	my @sw = ();
+	my ($g, $s, $t, $h, $j);
+
+	if ($groups - 1 > $per_group * $global) {
+		die "ERROR: $groups groups need $per_group x $global >= " .
+		    ($groups - 1) . " global links per group\n";
+	}
+
+	for ($g = 0; $g < $groups; $g++) {
+		for ($s = 0; $s < $per_group; $s++) {
+			my $n = $g * $per_group + $s + 1;
+			$sw[$g][$s] = add_switch($hosts + $per_group - 1 + $global,
+						 "ibdf$n");
+			for ($h = 0; $h < $hosts; $h++) {
+				connect_ports($sw[$g][$s], $h + 1, add_host(), 1);
+			}
+		}
+		for ($s = 0; $s < $per_group; $s++) {
+			for ($t = $s + 1; $t < $per_group; $t++) {
+				connect_ports($sw[$g][$s], $local_base + $t,
+					      $sw[$g][$t], $local_base + $s + 1);
+			}
+		}
+	}
+
+	for ($g = 0; $g < $groups; $g++) {
+		for ($j = $g + 1; $j < $groups; $j++) {
+			my $slot_g = $j - 1;
+			my $slot_j = $g;
+			connect_ports($sw[$g][$slot_g % $per_group],
+				      $global_base + 1 + int($slot_g / $per_group),
+				      $sw[$j][$slot_j % $per_group],
+				      $global_base + 1 + int($slot_j / $per_group));
+		}
+	}
+}
+
+# port p+1+2d is the + direction of dimension d and p+2+2d the - direction
+sub gen_torus
+{
+	my ($x, $y, $z, $hosts) = @_;
+	my @dims = ($x, $y, $z);
+	my @sw = ();
+	my ($i, $h, $d);
+	my $total = $x * $y * $z;
+
+	for ($i = 0; $i < $total; $i++) {
+		$sw[$i] = add_switch($hosts + 6, "ibtorus" . ($i + 1));
+		for ($h = 0; $h < $hosts; $h++) {
+			connect_ports($sw[$i], $h + 1, add_host(), 1);
+		}
+	}
+
+	for ($i = 0; $i < $total; $i++) {
+		my @c = ($i % $x, int($i / $x) % $y, int($i / ($x * $y)));
+		for ($d = 0; $d < 3; $d++) {
+			next if ($dims[$d] < 2);
+			my @nc = @c;
+			$nc[$d] = ($nc[$d] + 1) % $dims[$d];
+			my $ni = $nc[0] + $nc[1] * $x + $nc[2] * $x * $y;
+			connect_ports($sw[$i], $hosts + 1 + 2 * $d,
+				      $sw[$ni], $hosts + 2 + 2 * $d);
+		}
+	}
+}
+
+#
+# Cache file
+#
+
+# 64 bit values; in SMP data and in the cache file
+sub smp64
+{
+	my ($val) = @_;
+	return pack("NN", int($val / 4294967296), $val % 4294967296);
+}
+
+sub cache64
+{
+	my ($val) = @_;
+	return pack("VV", $val % 4294967296, int($val / 4294967296));
+}
+
+sub node_info
+{
+	my ($n) = @_;
+	my $is_sw = $type[$n] == $NODE_SWITCH;
+	my $port_guid = $is_sw ? $guid[$n] : $guid[$n] + 1;
+
+	return pack("a$SMP_DATA_SIZE",
+		    pack("CCCC", 1, 1, $type[$n], $numports[$n]) .
+		    smp64($guid[$n]) . smp64($guid[$n]) . smp64($port_guid) .
+		    pack("nnN", $is_sw ? 8 : 128, $is_sw ? 0xbd36 : 0x673c, 0xa0) .
+		    pack("C", $is_sw ? 0 : 1) . substr(pack("N", 0x02c9), 1));
+}
+
+sub switch_info
+{
+	my ($lft_top) = @_;
+
+	return pack("a$SMP_DATA_SIZE", pack("nnnn", 0xc000, 0, 0x200, $lft_top));
+}
+
+sub port_info
+{
+	my ($port_lid, $portnum, $up) = @_;
+	my $state = $up ? 4 : 1;    # Active : Down
+	my $phys  = $up ? 5 : 2;    # LinkUp : Polling
+
+	return pack("a$SMP_DATA_SIZE",
+		    pack("a8", "") . pack("NN", 0xfe800000, 0) .
+		    pack("nnNnn", $port_lid, 1, 0, 0, 0) .
+		    pack("CCCC", $portnum, 3, 3, $up ? $width : 0) .
+		    pack("CCCC", (7 << 4) | $state, ($phys << 4) | 2, 0,
+			 (($up ? $speed : 0) << 4) | 7) .
+		    pack("C", 4 << 4));
+}
+
+# directed route from node $from to every node
+sub dr_paths
+{
+	my ($from) = @_;
+	my @path = ();
+	my @queue = ($from);
+	my ($n, $p);
+
+	$path[$from] = [];
+	while (@queue) {
+		$n = shift(@queue);
+		for ($p = 1; $p <= $numports[$n]; $p++) {
+			next if (!defined($peer[$n][$p]));
+			my $rem = $peer[$n][$p][0];
+			next if (defined($path[$rem]));
+			$path[$rem] = [ @{$path[$n]}, $p ];
+			if (scalar(@{$path[$rem]}) > 63) {
+				die "ERROR: $name[$rem] is more than 63 hops away\n";
+			}
+			# only switches forward directed route SMPs
+			push(@queue, $rem) if ($type[$rem] == $NODE_SWITCH);
+		}
+	}
+	return @path;
+}
+
+sub write_cache
+{
+	my ($file) = @_;
+	my $num_nodes = scalar(@type);
+	my $num_ports = 0;
+	my $maxhops = 0;
+	my $lft_top = $num_nodes > 0xBFFF ? 0xBFFF : $num_nodes;
+	my $from = 0;
+	my ($n, $p);
+
+	# the first host is where the fabric was "discovered" from
+	while ($type[$from] != $NODE_CA) { $from++; }
+	my @path = dr_paths($from);
+
+	for ($n = 0; $n < $num_nodes; $n++) {
+		if (!defined($path[$n])) {
+			die "ERROR: $name[$n] is not connected to the fabric\n";
+		}
+		$maxhops = scalar(@{$path[$n]}) if (scalar(@{$path[$n]}) > $maxhops);
+		$num_ports += $type[$n] == $NODE_SWITCH ? $numports[$n] + 1 : 1;
+	}
+
+	open(CACHE, ">$file") or die "ERROR: failed to open $file: $!\n";
+	binmode(CACHE);
+
+	# the from node is a node GUID
+	print CACHE pack("VVVV", $CACHE_MAGIC, $CACHE_VERSION, $num_nodes,
+			 $num_ports) . cache64($guid[$from]) .
+			 pack("V", $maxhops);
+
+	for ($n = 0; $n < $num_nodes; $n++) {
+		my $is_sw = $type[$n] == $NODE_SWITCH;
+		my @ports = $is_sw ? (0 .. $numports[$n]) : (1);
+		my $port_guid = $is_sw ? $guid[$n] : $guid[$n] + 1;
+
+		print CACHE pack("vCC", $lid[$n], 0, 0) .
+			($is_sw ? switch_info($lft_top) :
+				  pack("a$SMP_DATA_SIZE", "")) .
+			cache64($guid[$n]) .
+			pack("CC", $type[$n], $numports[$n]) .
+			node_info($n) .
+			pack("a$SMP_DATA_SIZE", $desc[$n]) .
+			pack("C", scalar(@ports));
+		foreach $p (@ports) {
+			print CACHE cache64($port_guid) . pack("C", $p);
+		}
+	}
+
+	for ($n = 0; $n < $num_nodes; $n++) {
+		my $is_sw = $type[$n] == $NODE_SWITCH;
+		my @ports = $is_sw ? (0 .. $numports[$n]) : (1);
+		my $port_guid = $is_sw ? $guid[$n] : $guid[$n] + 1;
+
+		foreach $p (@ports) {
+			my $rem = $peer[$n][$p];
+			my $up = $p == 0 || defined($rem);
+
+			print CACHE cache64($port_guid) . pack("CC", $p, 0) .
+				pack("vC", $lid[$n], 0) .
+				port_info($lid[$n], $p, $up) .
+				cache64($guid[$n]);
+			if (defined($rem)) {
+				my ($r, $rp) = @$rem;
+				my $rem_guid = $type[$r] == $NODE_SWITCH ?
+					$guid[$r] : $guid[$r] + 1;
+				print CACHE pack("C", 1) . cache64($rem_guid) .
+					pack("C", $rp);
+			} else {
+				print CACHE pack("C", 0) . cache64(0) . pack("C", 0);
+			}
+		}
+	}
+
+	close(CACHE) or die "ERROR: failed to write $file: $!\n";
+}
+
+sub write_map
+{
+	my ($file) = @_;
+	my $n;
+
+	open(MAP, ">$file") or die "ERROR: failed to open $file: $!\n";
+	print MAP "# written by ibfabricgen.pl\n";
+	for ($n = 0; $n < scalar(@type); $n++) {
+		printf MAP "0x%016x \"%s\"\n", $guid[$n], $name[$n];
+	}
+	close(MAP) or die "ERROR: failed to write $file: $!\n";
+}
+
+sub write_hosts
+{
+	my ($file) = @_;
+	my @ranges = ();
+	my $lo;
+
+	for ($lo = 1; $lo <= $num_hosts; $lo += $HOSTS_PER_RANGE) {
+		my $hi = $lo + $HOSTS_PER_RANGE - 1;
+		$hi = $num_hosts if ($hi > $num_hosts);
+		push(@ranges, "$host_prefix\[$lo-$hi\]");
+	}
+
+	open(HOSTS, ">$file") or die "ERROR: failed to open $file: $!\n";
+	print HOSTS join(",", @ranges) . "\n";
+	close(HOSTS) or die "ERROR: failed to write $file: $!\n";
+}
+
+#
+# Main
+#
+
+if (!getopts("ht:o:m:H:p:l:")) { usage(); }
+if (defined $Getopt::Std::opt_h) { usage(); }
+if (!defined $Getopt::Std::opt_t || !defined $Getopt::Std::opt_o) { usage(); }
+if (defined $Getopt::Std::opt_p) { $host_prefix = $Getopt::Std::opt_p; }
+if (defined $Getopt::Std::opt_l) {
+	my %widths = ("1x" => 1, "4x" => 2, "8x" => 4, "12x" => 8);
+	my %speeds = ("SDR" => 1, "DDR" => 2, "QDR" => 4);
+
+	if ($Getopt::Std::opt_l !~ /^(\d+x)(SDR|DDR|QDR)$/i
+	    || !defined($widths{lc($1)})) {
+		die "ERROR: invalid link rate \"$Getopt::Std::opt_l\"\n";
+	}
+	$width = $widths{lc($1)};
+	$speed = $speeds{uc($2)};
+}
+
+my ($topo, $params) = split(/:/, $Getopt::Std::opt_t, 2);
+my @args = split(/,/, defined($params) ? $params : "");
+foreach my $arg (@args) {
+	if ($arg !~ /^\d+$/ || $arg < 1) {
+		die "ERROR: invalid parameter \"$arg\" for $topo\n";
+	}
+}
+
+if ($topo eq "ftree" && scalar(@args) == 2) {
+	gen_ftree(@args);
+} elsif ($topo eq "tapered" && scalar(@args) == 4) {
+	gen_tapered(@args);
+} elsif ($topo eq "dragonfly" && scalar(@args) == 4) {
+	gen_dragonfly(@args);
+} elsif ($topo eq "torus" && scalar(@args) == 4) {
+	gen_torus(@args);
+} else {
+	print STDERR "ERROR: invalid topology \"$Getopt::Std::opt_t\"\n";
+	usage();
+}
+
+write_cache($Getopt::Std::opt_o);
+if (defined $Getopt::Std::opt_m) { write_map($Getopt::Std::opt_m); }
+if (defined $Getopt::Std::opt_H) { write_hosts($Getopt::Std::opt_H); }
+
+printf STDERR "%s: %d hosts, %d switches\n", $Getopt::Std::opt_o,
+	$num_hosts, $num_switches;
+exit 0;
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define ARENA_DEFAULT_CHUNK (256 * 1024)
+#define ARENA_ALIGN 16
+
+typedef struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	/* keep data aligned for any type */
+	char data[] __attribute__ ((aligned(ARENA_ALIGN)));
+} arena_chunk_t;
+
+struct arena {
+	arena_chunk_t *chunks;
+	size_t chunk_size;
+	size_t bytes;
+	unsigned num_chunks;
+};
+
+arena_t *
+arena_create(size_t chunk_size)
+{
+	arena_t *arena = calloc(1, sizeof(*arena));
+
+	if (!arena)
+		return (NULL);
+	arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+	return (arena);
+}
+
+void
+arena_destroy(arena_t *arena)
+{
+	arena_chunk_t *chunk, *next;
+
+	if (!arena)
+		return;
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(arena);
+}
+
+void *
+arena_alloc(arena_t *arena, size_t size)
+{
+	arena_chunk_t *chunk = arena->chunks;
+	void *rc;
+
+	size = (size + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		size_t csize = arena->chunk_size;
+
+		if (size > csize)
+			csize = size;
+		if ((chunk = malloc(sizeof(*chunk) + csize)) == NULL)
+			return (NULL);
+		chunk->size = csize;
+		chunk->used = 0;
+
+		/* Keep filling the current chunk if this is an oversized
+		 * request; it is likely to have room left for small ones.
+		 */
+		if (arena->chunks && size > arena->chunk_size) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+		arena->num_chunks++;
+	}
+
+	rc = &chunk->data[chunk->used];
+	chunk->used += size;
+	arena->bytes += size;
+	return (rc);
+}
+
+void *
+arena_calloc(arena_t *arena, size_t nmemb, size_t size)
+{
+	void *rc;
+
+	if (size && nmemb > SIZE_MAX / size)
+		return (NULL);
+	if ((rc = arena_alloc(arena, nmemb * size)) != NULL)
+		memset(rc, 0, nmemb * size);
+	return (rc);
+}
+
+char *
+arena_strdup(arena_t *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *rc = arena_alloc(arena, len);
+
+	if (rc)
+		memcpy(rc, str, len);
+	return (rc);
+}
+
+size_t
+arena_bytes(arena_t *arena)
+{
+	return (arena->bytes);
+}
+
+unsigned
+arena_chunks(arena_t *arena)
+{
+	return (arena->num_chunks);
+}
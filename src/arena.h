@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+/* A bump allocator for data which lives until the tool is done with it.
+ *
+ * Memory is carved out of large chunks and can not be freed individually;
+ * arena_destroy() releases everything in one step.
+ */
+typedef struct arena arena_t;
+
+/* chunk_size of 0 selects the default */
+arena_t *arena_create(size_t chunk_size);
+void arena_destroy(arena_t *arena);
+
+/* size bytes aligned for any type; NULL on allocation failure */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/* as arena_alloc() but zeroed */
+void *arena_calloc(arena_t *arena, size_t nmemb, size_t size);
+
+/* copy str into the arena */
+char *arena_strdup(arena_t *arena, const char *str);
+
+/* bytes handed out and chunks allocated so far */
+size_t arena_bytes(arena_t *arena);
+unsigned arena_chunks(arena_t *arena);
+
+#endif /* _ARENA_H */
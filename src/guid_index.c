@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "guid_index.h"
+
+#define GUID_INDEX_MIN_BITS 4
+
+/* keep the table at most half full */
+#define GUID_INDEX_MAX_LOAD(gi) ((gi)->mask >> 1)
+
+typedef struct guid_index_rec {
+	uint64_t guid;
+	int val;	/* -1 == empty slot */
+} guid_index_rec_t;
+
+struct guid_index {
+	guid_index_rec_t *recs;
+	unsigned bits;
+	unsigned mask;
+	unsigned count;
+};
+
+/* Fibonacci hashing; GUIDs from one vendor differ mostly in the low bits
+ * so take the high bits of the product.
+ */
+static inline unsigned
+guid_slot(const guid_index_t *gi, uint64_t guid)
+{
+	return ((unsigned)((guid * 0x9E3779B97F4A7C15ULL) >> (64 - gi->bits)));
+}
+
+static guid_index_rec_t *
+alloc_recs(unsigned size)
+{
+	guid_index_rec_t *recs = malloc(size * sizeof(*recs));
+	unsigned i;
+
+	if (!recs)
+		return (NULL);
+	for (i = 0; i < size; i++) {
+		recs[i].guid = 0;
+		recs[i].val = -1;
+	}
+	return (recs);
+}
+
+static int
+guid_index_grow(guid_index_t *gi)
+{
+	guid_index_rec_t *old = gi->recs;
+	unsigned old_size = gi->mask + 1;
+	unsigned i;
+
+	gi->recs = alloc_recs(old_size << 1);
+	if (!gi->recs) {
+		gi->recs = old;
+		return (-1);
+	}
+	gi->bits++;
+	gi->mask = (old_size << 1) - 1;
+
+	for (i = 0; i < old_size; i++) {
+		unsigned s;
+		if (old[i].val < 0)
+			continue;
+		s = guid_slot(gi, old[i].guid);
+		while (gi->recs[s].val >= 0)
+			s = (s + 1) & gi->mask;
+		gi->recs[s] = old[i];
+	}
+	free(old);
+	return (0);
+}
+
+guid_index_t *
+guid_index_create(unsigned expected)
+{
+	guid_index_t *gi = calloc(1, sizeof(*gi));
+
+	if (!gi)
+		return (NULL);
+
+	gi->bits = GUID_INDEX_MIN_BITS;
+	while ((1U << gi->bits) < 2 * expected)
+		gi->bits++;
+	gi->mask = (1U << gi->bits) - 1;
+
+	gi->recs = alloc_recs(gi->mask + 1);
+	if (!gi->recs) {
+		free(gi);
+		return (NULL);
+	}
+	return (gi);
+}
+
+void
+guid_index_destroy(guid_index_t *gi)
+{
+	if (!gi)
+		return;
+	free(gi->recs);
+	free(gi);
+}
+
+int
+guid_index_insert(guid_index_t *gi, uint64_t guid, int val)
+{
+	unsigned s;
+
+	if (gi->count >= GUID_INDEX_MAX_LOAD(gi) && guid_index_grow(gi))
+		return (-1);
+
+	for (s = guid_slot(gi, guid); gi->recs[s].val >= 0;
+	     s = (s + 1) & gi->mask) {
+		if (gi->recs[s].guid == guid) {
+			gi->recs[s].val = val;
+			return (0);
+		}
+	}
+	gi->recs[s].guid = guid;
+	gi->recs[s].val = val;
+	gi->count++;
+	return (0);
+}
+
+int
+guid_index_lookup(guid_index_t *gi, uint64_t guid)
+{
+	unsigned s;
+
+	for (s = guid_slot(gi, guid); gi->recs[s].val >= 0;
+	     s = (s + 1) & gi->mask)
+		if (gi->recs[s].guid == guid)
+			return (gi->recs[s].val);
+	return (-1);
+}
+
+unsigned
+guid_index_count(guid_index_t *gi)
+{
+	return (gi->count);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _GUID_INDEX_H
+#define _GUID_INDEX_H
+
+#include <stdint.h>
+
+/* A GUID to int index.
+ *
+ * Open addressing with linear probing over a flat array of {guid, value}
+ * records.  The table is sized from the number of entries the caller
+ * expects (normally the node count of a discovered fabric) and grows
+ * itself if that estimate turns out to be low, so lookups stay O(1)
+ * regardless of fabric size.
+ */
+typedef struct guid_index guid_index_t;
+
+/*
+ * guid_index_create():
+ *
+ * Create an index sized to hold "expected" entries without growing.
+ * Returns NULL on allocation failure.
+ */
+guid_index_t *guid_index_create(unsigned expected);
+
+void guid_index_destroy(guid_index_t *gi);
+
+/*
+ * guid_index_insert():
+ *
+ * Map "guid" to "val" (val must be >= 0).  An existing mapping for guid is
+ * replaced.  Returns 0 on success, -1 on allocation failure.
+ */
+int guid_index_insert(guid_index_t *gi, uint64_t guid, int val);
+
+/*
+ * guid_index_lookup():
+ *
+ * Returns the value stored for "guid" or -1 if it is not in the index.
+ */
+int guid_index_lookup(guid_index_t *gi, uint64_t guid);
+
+/*
+ * guid_index_count():
+ *
+ * Returns the number of entries in the index.
+ */
+unsigned guid_index_count(guid_index_t *gi);
+
+#endif /* _GUID_INDEX_H */
@@ -2215,6 +2215,109 @@ ssize_t hostlist_ranged_string(hostlist_t hl, size_t n, char *buf)
     return truncated ? -1 : len;
 }
 
+/* write the numeric part of hostrange through fn.
+ * returns the number of bytes written or -1 on error.
+ */
+static ssize_t
+_write_numstr(hostrange_t hr, hostlist_write_f fn, void *arg)
+{
+    char stack[64];
+    char *buf = stack;
+    /* "lo-hi" where each is at least width digits of an unsigned long */
+    size_t n = 2 * (hr->width + 21) + 2;
+    size_t len;
+    int rc;
+
+    if (hr->singlehost)
+        return 0;
+
+    if (n > sizeof(stack) && !(buf = malloc(n)))
+        return -1;
+
+    len = hostrange_numstr(hr, n, buf);
+    rc = fn(arg, buf, len);
+
+    if (buf != stack)
+        free(buf);
+    return rc < 0 ? -1 : (ssize_t) len;
+}
+
+/* write the next bracketed hostlist, i.e. prefix[n-m,k,...], through fn.
+ *
+ * leaves start pointing to one past last range object in bracketed list,
+ * and returns the number of bytes written or -1 if fn failed.
+ *
+ * Assumes hostlist is locked.
+ */
+static ssize_t
+_write_bracketed_list(hostlist_t hl, int *start, hostlist_write_f fn,
+                      void *arg)
+{
+    hostrange_t *hr = hl->hr;
+    int i = *start;
+    ssize_t len = 0;
+    size_t plen = strlen(hr[i]->prefix);
+    ssize_t m;
+    int bracket_needed = _is_bracket_needed(hl, i);
+
+    if (plen && fn(arg, hr[i]->prefix, plen) < 0)
+        return -1;
+    len += plen;
+
+    if (bracket_needed) {
+        if (fn(arg, "[", 1) < 0)
+            return -1;
+        len++;
+    }
+
+    for (;;) {
+        if ((m = _write_numstr(hr[i], fn, arg)) < 0)
+            return -1;
+        len += m;
+        if (++i >= hl->nranges || !hostrange_within_range(hr[i], hr[i-1]))
+            break;
+        /* only reached inside brackets */
+        if (fn(arg, ",", 1) < 0)
+            return -1;
+        len++;
+    }
+
+    if (bracket_needed) {
+        if (fn(arg, "]", 1) < 0)
+            return -1;
+        len++;
+    }
+
+    *start = i;
+    return len;
+}
+
+ssize_t hostlist_ranged_write(hostlist_t hl, hostlist_write_f fn, void *arg)
+{
+    int i = 0;
+    ssize_t n;
+    ssize_t len = 0;
+
+    LOCK_HOSTLIST(hl);
+    while (i < hl->nranges) {
+        if ((n = _write_bracketed_list(hl, &i, fn, arg)) < 0) {
+            len = -1;
+            break;
+        }
+        len += n;
+        if ((len > 0) && (i < hl->nranges)) {
+            if (fn(arg, ",", 1) < 0) {
+                len = -1;
+                break;
+            }
+            len++;
+        }
+    }
+    UNLOCK_HOSTLIST(hl);
+
+    return len;
+}
+
 /* ----[ hostlist iterator functions ]---- */
 
 static hostlist_iterator_t hostlist_iterator_new(void)
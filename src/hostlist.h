@@ -281,6 +281,17 @@ void hostlist_uniq(hostlist_t hl);
 ssize_t hostlist_ranged_string(hostlist_t hl, size_t n, char *buf);
 ssize_t hostset_ranged_string(hostset_t hs, size_t n, char *buf);
 
+/* hostlist_ranged_write():
+ *
+ * Write the same representation as hostlist_ranged_string() a piece at
+ * a time through fn, so the result is never truncated.  fn is passed arg
+ * and a string of len bytes (not NUL terminated) and returns < 0 on error.
+ *
+ * Returns the total number of bytes written, or -1 if fn failed.
+ */
+typedef int (*hostlist_write_f)(void *arg, const char *str, size_t len);
+ssize_t hostlist_ranged_write(hostlist_t hl, hostlist_write_f fn, void *arg);
+
 /* hostlist_deranged_string():
  *
  * Writes the string representation of the hostlist hl into buf,
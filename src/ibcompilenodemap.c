@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+/**
+ * Compile a node name map in to the form nnmap_open() can mmap.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "nnmap.h"
+
+static char *argv0 = "ibcompilenodemap";
+
+static void usage(void)
+{
+	fprintf(stderr, "%s [-h] <node_name_map> <compiled_map>\n"
+		"   Compile <node_name_map> for fast loading by slurm_topology "
+		"and ibgraphfabric.\n"
+		"   <compiled_map> is replaced atomically and may be given to "
+		"--node-name-map\n"
+		"   in place of the text map.  Recompile when the text map "
+		"changes.\n",
+		argv0);
+}
+
+int main(int argc, char **argv)
+{
+	int ch;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "h")) != -1) {
+		switch (ch) {
+			case 'h':
+				usage();
+				exit(0);
+			default:
+				usage();
+				exit(1);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2) {
+		usage();
+		exit(1);
+	}
+
+	if (nnmap_compile(argv[0], argv[1]))
+		exit(1);
+	return (0);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _IBCSR_H
+#define _IBCSR_H
+
+#include <stdint.h>
+
+/* The file written by "ibgraphfabric --format csr": the fabric as a
+ * compressed sparse row adjacency, laid out to be mapped and used in place.
+ *
+ * Every section starts 8 byte aligned, at the offset given in the header:
+ *
+ *   ibcsr_hdr_t
+ *   ibcsr_node_t nodes[num_nodes]
+ *   uint64_t     row[num_nodes + 1]	edges of node i are row[i]..row[i+1]
+ *   ibcsr_edge_t edges[num_edges]	both directions of every link
+ *   char         names[names_len]	NUL terminated, at ibcsr_node_t.name
+ *
+ * All fields are in the byte order of the host that wrote the file.  A
+ * reader checks magic, then byte_order: IBCSR_BYTE_ORDER as read means the
+ * same order as its own; IBCSR_BYTE_ORDER_SWAPPED means every field wider
+ * than a byte must be swapped.  See README for an example reader.
+ */
+#define IBCSR_MAGIC "IBCSR\0\0\0"
+#define IBCSR_VERSION 2
+#define IBCSR_BYTE_ORDER 0x01020304
+#define IBCSR_BYTE_ORDER_SWAPPED 0x04030201
+
+typedef struct ibcsr_hdr {
+	char magic[8];			/* IBCSR_MAGIC */
+	uint32_t byte_order;		/* IBCSR_BYTE_ORDER as written */
+	uint32_t version;		/* IBCSR_VERSION */
+	uint32_t num_nodes;
+	uint32_t pad;
+	uint64_t num_edges;
+	uint64_t nodes_off;		/* offsets from the start of the file */
+	uint64_t row_off;
+	uint64_t edges_off;
+	uint64_t names_off;
+	uint64_t names_len;
+} ibcsr_hdr_t;
+
+typedef struct ibcsr_node {
+	uint64_t guid;
+	uint32_t name;			/* offset in to names */
+	uint8_t type;			/* 1 CA, 2 switch, 3 router */
+	uint8_t numports;
+	uint16_t pad;
+} ibcsr_node_t;
+
+typedef struct ibcsr_edge {
+	uint32_t target;		/* index in to nodes */
+	uint8_t port;
+	uint8_t target_port;
+	uint8_t width;			/* lanes: 1, 2, 4, 8 or 12 */
+	uint8_t pad;
+	uint32_t lane_mbps;		/* signalling rate of each lane */
+} ibcsr_edge_t;
+
+#endif /* _IBCSR_H */
@@ -49,16 +49,28 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <regex.h>
+#include <ctype.h>
+#include <sys/time.h>
 
-#include <complib/cl_nodenamemap.h>
 #include <infiniband/ibnetdisc.h>
 #include <infiniband/mad.h>
 
+#include "stats.h"
+#include "nnmap.h"
+#include "outbuf.h"
+#include "guid_index.h"
+#include "hostlist.h"
+#include "portrate.h"
+#include "mad_window.h"
+#include "ibcsr.h"
+
 
 char *argv0 = NULL;
 
 static char *node_name_map_file = NULL;
-static nn_map_t *node_name_map = NULL;
+static char *load_cache_file = NULL;
+static char *scope_hosts = NULL;
+static nnmap_t *node_name_map = NULL;
 
 struct ibmad_port *ibmad_port;
 ib_portid_t *ibd_sm_id;
@@ -66,67 +78,229 @@ ib_portid_t sm_portid = { 0 };
 
 char *node_guid_str = NULL;
 char *root_regex = NULL;
-//char *node_node_red = NULL;
 char *ignore_regex = NULL;
 char *cluster_name = NULL;
 uint64_t node_guid = 0;
 char *dr_path = NULL;
 int combine_edges = 0;
+int collapse_leaves = 0;
+int layout = 0;
 
-#define HTSZ 137
-#define HASHGUID(guid) (((uint32_t)(((uint32_t)(guid) * 101) ^ ((uint32_t)((guid) >> 32) * 103))) % HTSZ)
-struct lnode {
-	struct lnode *next;
-	ibnd_node_t *node;
-	char port_visited[256];
+/* -M: routes to draw in red */
+struct route {
+	char *src;
+	char *dst;
+	int src_idx;
+	int dst_idx;
+	uint16_t dlid;
+	int idx;		/* where the trace has got to */
+	int hops;
+	const char *err;
+};
+struct route *routes = NULL;
+int num_routes = 0;
+
+/* --heat: seconds between the two counter samples */
+int heat_secs = 0;
+
+/* --max-mads: MADs kept in flight by -M and --heat */
+int max_mads = 16;
+
+/* --diff: the older snapshot to compare with; --diff-summary: where to list
+ * the changes */
+char *diff_file = NULL;
+char *diff_summary_file = NULL;
+
+/* -M: one block of 64 LFT entries of a switch */
+struct lft_block {
+	uint8_t port[64];	/* by dlid % 64 */
+	int ok;			/* 1 read, -1 failed, 0 not yet */
+	int idx;
+	int block;
+};
+
+struct links {
+	uint8_t pnum;
+	uint64_t rem_guid;
+	uint8_t rem_pnum;
+	int combine_num;
+	int routed;
+	float util;		/* --heat; < 0 if not sampled */
 };
 
+/* Nodes are numbered densely in fabric list order; the ports visited are a
+ * bitset with a run of numports + 1 bits for each node.
+ */
 struct local_fabric {
 	int num_nodes;
 	int rank_sep;
-	struct lnode *nodes[HTSZ];
-	struct lnode *roots;
-	struct lnode *leafs;
+	guid_index_t *index;		/* node GUID to dense index */
+	ibnd_node_t **nodes;		/* by index */
+	const char **names;		/* by index; borrowed from the name map */
+	unsigned long *ignored;		/* bit per index matching -i */
+	unsigned *port_base;		/* first bit of each node's ports */
+	unsigned num_port_bits;
+	unsigned long *port_visited;
+	int *roots;			/* indexes, in the order found */
+	int num_roots;
+	int *leafs;
+	int num_leafs;
+
+	/* edges of the node being drawn; with -e link_slot[remote index] is
+	 * its edge if link_owner[remote index] is the node being drawn */
+	struct links *links;
+	int *link_slot;
+	int *link_owner;
+
+	/* --collapse-leaves: CAs are drawn as one node per switch */
+	unsigned long *collapsed;	/* bit per CA index folded away */
+	hostlist_t *cas;		/* by switch index */
+	int *ca_links;			/* by switch index */
+	int *ca_count;			/* by switch index */
+	int num_folded;			/* CAs less the aggregates */
+
+	/* --layout: position of each drawn node in points */
+	int *x;
+	int *y;
+
+	/* -M: ports on a route, laid out as port_visited; LFT blocks read,
+	 * indexed by (node index << 16 | block number) */
+	unsigned long *routed;
+	guid_index_t *lft_index;
+	struct lft_block *lft;
+	int num_lft;
+	int lft_size;
+
+	/* --heat: utilization of each port, laid out as port_visited */
+	float *util;
 } lfab;
 
-static struct lnode *find_lnode(uint64_t guid)
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+#define BITMAP_LONGS(bits) ((bits) / BITS_PER_LONG + 1)
+
+static inline void set_bit(unsigned long *map, unsigned bit)
 {
-	int hash = HASHGUID(guid) % HTSZ;
-	struct lnode *lnode;
+	map[bit / BITS_PER_LONG] |= 1UL << (bit % BITS_PER_LONG);
+}
 
-	for (lnode = lfab.nodes[hash]; lnode; lnode = lnode->next)
-		if (lnode->node->guid == guid)
-			return lnode;
-	return (NULL);
+static inline int test_bit(unsigned long *map, unsigned bit)
+{
+	return ((map[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1);
 }
-static void insert_node(struct lnode *lnode)
+
+static void index_fabric(ibnd_fabric_t *fabric)
 {
-	int hash_idx = HASHGUID(lnode->node->guid) % HTSZ;
-	/* keep track by hash */
-	lnode->next = lfab.nodes[hash_idx];
-	lfab.nodes[hash_idx] = lnode;
+	ibnd_node_t *node;
+	unsigned bits = 0;
+	int i, max_ports = 0;
+
+	for (node = fabric->nodes; node; node = node->next)
+		lfab.num_nodes++;
+
+	lfab.index = guid_index_create(lfab.num_nodes);
+	lfab.nodes = calloc(lfab.num_nodes, sizeof(*lfab.nodes));
+	lfab.names = calloc(lfab.num_nodes, sizeof(*lfab.names));
+	lfab.ignored = calloc(BITMAP_LONGS(lfab.num_nodes),
+			      sizeof(*lfab.ignored));
+	lfab.port_base = calloc(lfab.num_nodes, sizeof(*lfab.port_base));
+	lfab.roots = calloc(lfab.num_nodes, sizeof(*lfab.roots));
+	lfab.leafs = calloc(lfab.num_nodes, sizeof(*lfab.leafs));
+	if (!lfab.index || !lfab.ignored || (lfab.num_nodes && (!lfab.nodes
+	    || !lfab.names || !lfab.port_base || !lfab.roots || !lfab.leafs))) {
+		fprintf(stderr, "ERROR: failed to allocate node index\n");
+		exit(1);
+	}
+
+	for (i = 0, node = fabric->nodes; node; i++, node = node->next) {
+		lfab.nodes[i] = node;
+		lfab.port_base[i] = bits;
+		bits += node->numports + 1;
+		if (node->numports > max_ports)
+			max_ports = node->numports;
+		if (guid_index_insert(lfab.index, node->guid, i)) {
+			fprintf(stderr, "ERROR: failed to allocate node index\n");
+			exit(1);
+		}
+	}
+
+	lfab.num_port_bits = bits;
+	lfab.port_visited = calloc(BITMAP_LONGS(bits),
+				   sizeof(*lfab.port_visited));
+	if (!lfab.port_visited) {
+		fprintf(stderr, "ERROR: failed to allocate port bitmap\n");
+		exit(1);
+	}
+
+	lfab.links = calloc(max_ports + 1, sizeof(*lfab.links));
+	if (combine_edges) {
+		lfab.link_slot = calloc(lfab.num_nodes + 1,
+					sizeof(*lfab.link_slot));
+		lfab.link_owner = malloc((lfab.num_nodes + 1)
+					 * sizeof(*lfab.link_owner));
+		if (lfab.link_owner)
+			memset(lfab.link_owner, -1, (lfab.num_nodes + 1)
+			       * sizeof(*lfab.link_owner));
+	}
+	if (!lfab.links || (combine_edges && (!lfab.link_slot
+	    || !lfab.link_owner))) {
+		fprintf(stderr, "ERROR: failed to allocate link table\n");
+		exit(1);
+	}
 }
 
-static void flag_port(ibnd_node_t *node, uint8_t portnum)
+static void free_index(void)
 {
-	struct lnode *lnode = find_lnode(node->guid);
-	if (!lnode) {
-		lnode = calloc(1, sizeof(*lnode));
-		lnode->node = node;
-		insert_node(lnode);
+	guid_index_destroy(lfab.index);
+	free(lfab.nodes);
+	free(lfab.names);
+	free(lfab.ignored);
+	free(lfab.port_base);
+	free(lfab.port_visited);
+	free(lfab.roots);
+	free(lfab.leafs);
+	free(lfab.links);
+	free(lfab.link_slot);
+	free(lfab.link_owner);
+	if (lfab.cas) {
+		int i;
+		for (i = 0; i < lfab.num_nodes; i++)
+			if (lfab.cas[i])
+				hostlist_destroy(lfab.cas[i]);
 	}
-	lnode->port_visited[portnum] = 1;
+	free(lfab.collapsed);
+	free(lfab.cas);
+	free(lfab.ca_links);
+	free(lfab.ca_count);
+	free(lfab.x);
+	free(lfab.y);
+	free(lfab.routed);
+	if (lfab.lft_index)
+		guid_index_destroy(lfab.lft_index);
+	free(lfab.lft);
+	free(lfab.util);
+}
+
+static void flag_port(int idx, uint8_t portnum)
+{
+	unsigned bit;
+
+	if (portnum > lfab.nodes[idx]->numports)
+		return;
+	bit = lfab.port_base[idx] + portnum;
+	set_bit(lfab.port_visited, bit);
 }
 
-static int port_flagged(uint64_t guid, uint8_t portnum)
+static int port_flagged(int idx, uint8_t portnum)
 {
-	struct lnode *node = find_lnode(guid);
-	if (!node)
+	unsigned bit;
+
+	if (portnum > lfab.nodes[idx]->numports)
 		return 0;
-	return (node->port_visited[portnum]);
+	bit = lfab.port_base[idx] + portnum;
+	return (test_bit(lfab.port_visited, bit));
 }
 
-static void id_root(ibnd_node_t *node, char *node_name)
+static void id_root(int idx, const char *node_name)
 {
 	int rc;
 	static regex_t exp;
@@ -147,88 +321,1116 @@ static void id_root(ibnd_node_t *node, char *node_name)
 		regex_compiled = 1;
 	}
 
-	if (regexec(&exp, node_name, 0, NULL, 0) == 0) {
-		struct lnode *lnode = calloc(1, sizeof(*lnode));
-		if (!lnode) {
-			fprintf(stderr, "%s:%d calloc FAILED! (%s)\n",
-				__FUNCTION__, __LINE__, strerror(errno));
-			return;
-		}
-		lnode->node = node;
-		if (lfab.roots)
-			lnode->next = lfab.roots;
-		lfab.roots = lnode;
-	}
+	if (regexec(&exp, node_name, 0, NULL, 0) == 0)
+		lfab.roots[lfab.num_roots++] = idx;
+}
+
+static int ignore_node(const char *node_name)
+{
+	int rc;
+	static regex_t exp;
+	static int regex_compiled = 0;
+	static int regex_failed = 0;
+
+	if (!ignore_regex || regex_failed)
+		return 0;
+
+	if (!regex_compiled) { /* only compile it one time */
+		if ((rc = regcomp(&exp, ignore_regex, REG_ICASE |
+				REG_NOSUB | REG_EXTENDED)) != 0) {
+			fprintf(stderr, "ERROR: regcomp failed on \"%s\": %d\n",
+				root_regex, rc);
+			regex_failed = 1;
+			return 0;
+		}
+		regex_compiled = 1;
+	}
+
+	return (regexec(&exp, node_name, 0, NULL, 0) == 0);
+}
+
+/* Name every node and test it against -i once, so drawing the edges needs
+ * neither.
+ */
+static void name_nodes(void)
+{
+	ibnd_node_t *node;
+	int idx;
+
+	stats_push("naming");
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		node = lfab.nodes[idx];
+		lfab.names[idx] = nnmap_name(node_name_map, node->guid,
+					     node->nodedesc);
+		if (ignore_node(lfab.names[idx]))
+			set_bit(lfab.ignored, idx);
+	}
+	stats_pop();
+}
+
+static inline int node_ignored(int idx)
+{
+	return (test_bit(lfab.ignored, idx));
+}
+
+static inline int node_collapsed(int idx)
+{
+	return (lfab.collapsed && test_bit(lfab.collapsed, idx));
+}
+
+/* Fold each CA in to the switch its first link goes to; links to any other
+ * switch are not drawn.  The aggregate is labeled with the host names, the
+ * part of each CA's name up to the first blank.
+ */
+static void collapse_cas(void)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *rem_port;
+	char host[256];
+	int idx, rem_idx, sw, pnum;
+	size_t len;
+
+	lfab.collapsed = calloc(BITMAP_LONGS(lfab.num_nodes),
+				sizeof(*lfab.collapsed));
+	lfab.cas = calloc(lfab.num_nodes + 1, sizeof(*lfab.cas));
+	lfab.ca_links = calloc(lfab.num_nodes + 1, sizeof(*lfab.ca_links));
+	lfab.ca_count = calloc(lfab.num_nodes + 1, sizeof(*lfab.ca_count));
+	if (!lfab.collapsed || !lfab.cas || !lfab.ca_links ||
+	    !lfab.ca_count) {
+		fprintf(stderr, "ERROR: failed to allocate leaf aggregates\n");
+		exit(1);
+	}
+
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		node = lfab.nodes[idx];
+		if (node->type != IB_NODE_CA || node_ignored(idx))
+			continue;
+
+		sw = -1;
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (!node->ports[pnum])
+				continue;
+			rem_port = node->ports[pnum]->remoteport;
+			if (!rem_port || rem_port->node->type != IB_NODE_SWITCH)
+				continue;
+			rem_idx = guid_index_lookup(lfab.index,
+						    rem_port->node->guid);
+			if (rem_idx < 0 || node_ignored(rem_idx))
+				continue;
+			if (sw < 0)
+				sw = rem_idx;
+			if (rem_idx == sw)
+				lfab.ca_links[sw]++;
+		}
+		if (sw < 0)
+			continue;
+
+		if (!lfab.cas[sw]) {
+			if (!(lfab.cas[sw] = hostlist_create(NULL))) {
+				fprintf(stderr, "ERROR: failed to allocate "
+					"hostlist\n");
+				exit(1);
+			}
+			lfab.num_folded--;
+		}
+		len = strcspn(lfab.names[idx], " \t");
+		if (len >= sizeof(host))
+			len = sizeof(host) - 1;
+		memcpy(host, lfab.names[idx], len);
+		host[len] = '\0';
+		hostlist_push_host(lfab.cas[sw], host);
+		lfab.ca_count[sw]++;
+		set_bit(lfab.collapsed, idx);
+		lfab.num_folded++;
+	}
+}
+
+static inline int node_drawn(int idx)
+{
+	return (!node_ignored(idx) && !node_collapsed(idx));
+}
+
+/* Find the roots among the nodes which will be drawn, in the order they are
+ * drawn.
+ */
+static void find_roots(void)
+{
+	int idx;
+
+	for (idx = 0; idx < lfab.num_nodes; idx++)
+		if (node_drawn(idx))
+			id_root(idx, lfab.names[idx]);
+}
+
+/** =========================================================================
+ * Host scope
+ *
+ * --hosts keeps the CAs whose host name (the part of the name up to the
+ * first blank) is in the hostlist, the switches they are cabled to and the
+ * switches on the shortest paths from the first of those to the rest; every
+ * other node is treated as matched by -i.  The paths come from one BFS over
+ * the switches, which stops once every leaf is reached, so they share as
+ * many spines as the BFS order allows.
+ */
+static void scope_fabric(void)
+{
+	hostset_t hs;
+	ibnd_node_t *node;
+	ibnd_port_t *rem_port;
+	unsigned long *keep, *on_tree;
+	int *parent, *q, *leaves;
+	int n = lfab.num_nodes;
+	int idx, rem_idx, pnum, i, head = 0, tail = 0, num_leaves = 0;
+	int num_hosts = 0, num_kept = 0, reached = 1;
+	char host[256];
+	size_t len;
+
+	if (!(hs = hostset_create(scope_hosts))) {
+		fprintf(stderr, "ERROR: invalid hostlist \"%s\"\n",
+			scope_hosts);
+		exit(1);
+	}
+
+	keep = calloc(BITMAP_LONGS(n), sizeof(*keep));
+	on_tree = calloc(BITMAP_LONGS(n), sizeof(*on_tree));
+	parent = malloc((n + 1) * sizeof(*parent));
+	q = malloc((n + 1) * sizeof(*q));
+	leaves = malloc((n + 1) * sizeof(*leaves));
+	if (!keep || !on_tree || !parent || !q || !leaves) {
+		fprintf(stderr, "ERROR: failed to allocate host scope\n");
+		exit(1);
+	}
+
+	stats_push("scope");
+	for (idx = 0; idx < n; idx++) {
+		node = lfab.nodes[idx];
+		if (node->type != IB_NODE_CA || node_ignored(idx))
+			continue;
+		len = strcspn(lfab.names[idx], " \t");
+		if (len >= sizeof(host))
+			len = sizeof(host) - 1;
+		memcpy(host, lfab.names[idx], len);
+		host[len] = '\0';
+		if (!hostset_within(hs, host))
+			continue;
+
+		set_bit(keep, idx);
+		num_hosts++;
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (!node->ports[pnum])
+				continue;
+			rem_port = node->ports[pnum]->remoteport;
+			if (!rem_port || rem_port->node->type != IB_NODE_SWITCH)
+				continue;
+			rem_idx = guid_index_lookup(lfab.index,
+						    rem_port->node->guid);
+			if (rem_idx < 0 || node_ignored(rem_idx)
+			    || test_bit(keep, rem_idx))
+				continue;
+			set_bit(keep, rem_idx);
+			leaves[num_leaves++] = rem_idx;
+		}
+	}
+
+	if (num_hosts < hostset_count(hs))
+		fprintf(stderr, "WARNING: %d of %d hosts not found\n",
+			hostset_count(hs) - num_hosts, hostset_count(hs));
+
+	if (num_leaves > 1) {
+		for (idx = 0; idx < n; idx++)
+			parent[idx] = -1;
+		parent[leaves[0]] = leaves[0];
+		q[tail++] = leaves[0];
+		while (head < tail && reached < num_leaves) {
+			idx = q[head++];
+			node = lfab.nodes[idx];
+			for (pnum = 1; pnum <= node->numports; pnum++) {
+				if (!node->ports[pnum])
+					continue;
+				rem_port = node->ports[pnum]->remoteport;
+				if (!rem_port || rem_port->node->type
+						 != IB_NODE_SWITCH)
+					continue;
+				rem_idx = guid_index_lookup(lfab.index,
+							rem_port->node->guid);
+				if (rem_idx < 0 || parent[rem_idx] >= 0
+				    || node_ignored(rem_idx))
+					continue;
+				parent[rem_idx] = idx;
+				q[tail++] = rem_idx;
+				/* the only switches kept so far are leaves */
+				if (test_bit(keep, rem_idx))
+					reached++;
+			}
+		}
+
+		/* walk each leaf back until it meets the tree */
+		set_bit(on_tree, leaves[0]);
+		for (i = 1; i < num_leaves; i++) {
+			if (parent[leaves[i]] < 0)
+				continue;	/* not connected */
+			for (idx = leaves[i]; !test_bit(on_tree, idx);
+			     idx = parent[idx]) {
+				set_bit(on_tree, idx);
+				set_bit(keep, idx);
+			}
+		}
+	}
+
+	for (idx = 0; idx < n; idx++) {
+		if (test_bit(keep, idx))
+			num_kept++;
+		else
+			set_bit(lfab.ignored, idx);
+	}
+	stats_set("scope_nodes", num_kept);
+	stats_pop();
+
+	free(leaves);
+	free(q);
+	free(parent);
+	free(on_tree);
+	free(keep);
+	hostset_destroy(hs);
+}
+
+/** =========================================================================
+ * Routes
+ *
+ * Each route is followed hop by hop through the linear forwarding tables of
+ * the switches on it.  All the routes are advanced together: each round
+ * takes every route as far as the LFT blocks already read allow and then
+ * reads the blocks they are waiting on in one go, --max-mads at a time.
+ * Blocks are kept, failed reads included, so a block is read once no
+ * matter how many routes use it and a switch that does not answer is
+ * asked once.
+ */
+static int add_route(char *arg)
+{
+	struct route *r;
+	char *comma = strchr(arg, ',');
+
+	if (!comma || comma == arg || !comma[1] || strchr(comma + 1, ',')) {
+		fprintf(stderr, "ERROR: invalid route \"%s\"; use "
+			"<node>,<node>\n", arg);
+		return (-1);
+	}
+	if ((r = realloc(routes, (num_routes + 1) * sizeof(*r))) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate route\n");
+		exit(1);
+	}
+	routes = r;
+	r = &routes[num_routes++];
+	r->src = strndup(arg, comma - arg);
+	r->dst = strdup(comma + 1);
+	if (!r->src || !r->dst) {
+		fprintf(stderr, "ERROR: failed to allocate route\n");
+		exit(1);
+	}
+	r->src_idx = r->dst_idx = -1;
+	return (0);
+}
+
+/* one "<node> <node>" or "<node>,<node>" pair per line; # comments */
+static int read_routes(char *file)
+{
+	FILE *fp = fopen(file, "r");
+	char line[1024];
+	char *p, *end;
+	int rc = 0;
+
+	if (!fp) {
+		fprintf(stderr, "ERROR: failed to open \"%s\": %s\n", file,
+			strerror(errno));
+		return (-1);
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		for (p = line; isspace(*p); p++)
+			;
+		for (end = p + strlen(p); end > p && isspace(end[-1]); end--)
+			;
+		*end = '\0';
+		if (!*p)
+			continue;
+		for (end = p; *end && !isspace(*end); end++)
+			;
+		if (*end) {
+			*end++ = ',';
+			while (isspace(*end))
+				memmove(end, end + 1, strlen(end));
+		}
+		if (add_route(p))
+			rc = -1;
+	}
+	fclose(fp);
+	return (rc);
+}
+
+/* node indexes sorted by host name, the part of the name up to the first
+ * blank, so route ends can be given as either */
+static int *by_host;
+
+static int host_cmp(const char *a, size_t la, const char *b, size_t lb)
+{
+	int rc = memcmp(a, b, la < lb ? la : lb);
+
+	if (rc)
+		return (rc);
+	return (la < lb ? -1 : (la > lb));
+}
+
+static int by_host_cmp(const void *a, const void *b)
+{
+	const char *na = lfab.names[*(const int *)a];
+	const char *nb = lfab.names[*(const int *)b];
+
+	return (host_cmp(na, strcspn(na, " \t"), nb, strcspn(nb, " \t")));
+}
+
+/* the index of the node with the GUID, host name or name str; -1 if none */
+static int route_node(const char *str)
+{
+	char *end;
+	uint64_t guid;
+	size_t len = strlen(str);
+	int lo = 0, hi = lfab.num_nodes - 1, mid, rc, idx;
+
+	guid = strtoull(str, &end, 0);
+	if (*end == '\0' && (idx = guid_index_lookup(lfab.index, guid)) >= 0)
+		return (idx);
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		idx = by_host[mid];
+		rc = host_cmp(str, len, lfab.names[idx],
+			      strcspn(lfab.names[idx], " \t"));
+		if (rc == 0)
+			return (idx);
+		if (rc < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	/* names with blanks in them */
+	for (idx = 0; idx < lfab.num_nodes; idx++)
+		if (strcmp(lfab.names[idx], str) == 0)
+			return (idx);
+	return (-1);
+}
+
+/* the port out of switch idx for dlid; -1 if the LFT can not be read, -2 if
+ * the block has not been read yet */
+static int lft_port(int idx, uint16_t dlid)
+{
+	uint64_t key = (uint64_t)idx << 16 | (dlid / 64);
+	int b;
+
+	if ((b = guid_index_lookup(lfab.lft_index, key)) < 0
+	    || !lfab.lft[b].ok)
+		return (-2);
+	if (lfab.lft[b].ok < 0)
+		return (-1);
+	return (lfab.lft[b].port[dlid % 64]);
+}
+
+/* queue the block of switch idx holding dlid for the next read */
+static void lft_want(int idx, uint16_t dlid)
+{
+	uint64_t key = (uint64_t)idx << 16 | (dlid / 64);
+	int b;
+
+	if (guid_index_lookup(lfab.lft_index, key) >= 0)
+		return;
+	if (lfab.num_lft == lfab.lft_size) {
+		int size = lfab.lft_size ? lfab.lft_size * 2 : 64;
+		void *lft = realloc(lfab.lft, size * sizeof(*lfab.lft));
+		if (!lft) {
+			fprintf(stderr, "ERROR: failed to allocate LFT "
+				"cache\n");
+			exit(1);
+		}
+		lfab.lft = lft;
+		lfab.lft_size = size;
+	}
+	b = lfab.num_lft;
+	if (guid_index_insert(lfab.lft_index, key, b)) {
+		fprintf(stderr, "ERROR: failed to allocate LFT cache\n");
+		exit(1);
+	}
+	lfab.lft[b].ok = 0;
+	lfab.lft[b].idx = idx;
+	lfab.lft[b].block = dlid / 64;
+	lfab.num_lft++;
+}
+
+static void lft_read(mad_req_t *req, void *arg)
+{
+	struct lft_block *blk = req->ctx;
+
+	blk->ok = req->ok ? 1 : -1;
+	if (req->ok)
+		memcpy(blk->port, req->data, sizeof(blk->port));
+}
+
+/* read the blocks queued from first on */
+static void read_lfts(int first)
+{
+	mad_req_t *reqs;
+	int b, n = 0;
+
+	if ((reqs = malloc((lfab.num_lft - first) * sizeof(*reqs))) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate LFT reads\n");
+		exit(1);
+	}
+	for (b = first; b < lfab.num_lft; b++)
+		mad_req_smp(&reqs[n++], lfab.nodes[lfab.lft[b].idx]->smalid,
+			    IB_ATTR_LINEARFORWTBL, lfab.lft[b].block,
+			    &lfab.lft[b]);
+	mad_window_run(ibmad_port, reqs, n, max_mads, lft_read, NULL);
+	free(reqs);
+}
+
+static void flag_route(int idx, int portnum)
+{
+	if (idx >= 0 && portnum <= lfab.nodes[idx]->numports)
+		set_bit(lfab.routed, lfab.port_base[idx] + portnum);
+}
+
+static inline int port_routed(int idx, int portnum)
+{
+	return (lfab.routed && test_bit(lfab.routed,
+					lfab.port_base[idx] + portnum));
+}
+
+/* the LID of node; a CA's is that of its first port with one */
+static uint16_t node_lid(ibnd_node_t *node)
+{
+	int pnum;
+
+	if (node->type == IB_NODE_SWITCH)
+		return (node->smalid);
+	for (pnum = 1; pnum <= node->numports; pnum++)
+		if (node->ports[pnum] && node->ports[pnum]->base_lid)
+			return (node->ports[pnum]->base_lid);
+	return (0);
+}
+
+/* take r as far as the LFT blocks read allow; returns 1 if it waits on one,
+ * 0 once it has arrived or r->err says why it stopped */
+static int trace_route(struct route *r)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *port, *rem_port;
+	int rem_idx, pnum;
+
+	for (; r->idx != r->dst_idx; r->hops++) {
+		node = lfab.nodes[r->idx];
+		if (r->hops > 64) {
+			r->err = "loop in the forwarding tables";
+			return (0);
+		}
+		if (node->type == IB_NODE_SWITCH) {
+			if ((pnum = lft_port(r->idx, r->dlid)) == -2) {
+				lft_want(r->idx, r->dlid);
+				return (1);
+			}
+			if (pnum < 0) {
+				r->err = "failed to read LFT";
+				return (0);
+			}
+			if (pnum == 0 || pnum > node->numports) {
+				r->err = "no route in LFT";
+				return (0);
+			}
+		} else {
+			if (r->hops) {
+				r->err = "route passes through a CA";
+				return (0);
+			}
+			/* leave a CA by its first connected port */
+			for (pnum = 1; pnum <= node->numports; pnum++)
+				if (node->ports[pnum]
+				    && node->ports[pnum]->remoteport)
+					break;
+			if (pnum > node->numports) {
+				r->err = "source is not connected";
+				return (0);
+			}
+		}
+		port = node->ports[pnum];
+		if (!port || !(rem_port = port->remoteport)) {
+			r->err = "route leads to an unconnected port";
+			return (0);
+		}
+		rem_idx = guid_index_lookup(lfab.index, rem_port->node->guid);
+		if (rem_idx < 0) {
+			r->err = "route leaves the discovered fabric";
+			return (0);
+		}
+
+		flag_route(r->idx, pnum);
+		flag_route(rem_idx, rem_port->portnum);
+		r->idx = rem_idx;
+	}
+	return (0);
+}
+
+static void trace_routes(void)
+{
+	int *active;
+	int num_active = 0, n, first, i;
+
+	stats_push("routes");
+	lfab.routed = calloc(BITMAP_LONGS(lfab.num_port_bits),
+			     sizeof(*lfab.routed));
+	lfab.lft_index = guid_index_create(256);
+	by_host = malloc((lfab.num_nodes + 1) * sizeof(*by_host));
+	active = malloc((num_routes + 1) * sizeof(*active));
+	if (!lfab.routed || !lfab.lft_index || !by_host || !active) {
+		fprintf(stderr, "ERROR: failed to allocate routes\n");
+		exit(1);
+	}
+	for (i = 0; i < lfab.num_nodes; i++)
+		by_host[i] = i;
+	qsort(by_host, lfab.num_nodes, sizeof(*by_host), by_host_cmp);
+
+	for (i = 0; i < num_routes; i++) {
+		struct route *r = &routes[i];
+
+		r->err = NULL;
+		if ((r->src_idx = route_node(r->src)) < 0
+		    || (r->dst_idx = route_node(r->dst)) < 0) {
+			fprintf(stderr, "WARNING: route %s -> %s: node \"%s\" "
+				"not found\n", r->src, r->dst,
+				r->src_idx < 0 ? r->src : r->dst);
+			continue;
+		}
+		r->idx = r->src_idx;
+		r->hops = 0;
+		r->dlid = node_lid(lfab.nodes[r->dst_idx]);
+		if (!r->dlid)
+			r->err = "destination has no LID";
+		else
+			active[num_active++] = i;
+	}
+
+	/* every round moves each waiting route at least one hop */
+	while (num_active) {
+		first = lfab.num_lft;
+		for (i = n = 0; i < num_active; i++)
+			if (trace_route(&routes[active[i]]))
+				active[n++] = active[i];
+		num_active = n;
+		if (lfab.num_lft > first)
+			read_lfts(first);
+	}
+
+	for (i = 0; i < num_routes; i++)
+		if (routes[i].err)
+			fprintf(stderr, "WARNING: route %s -> %s: %s\n",
+				routes[i].src, routes[i].dst, routes[i].err);
+
+	free(active);
+	free(by_host);
+	by_host = NULL;
+	stats_set("lft_blocks", lfab.num_lft);
+	stats_pop();
+}
+
+/** =========================================================================
+ * Utilization
+ *
+ * The data counters of one end of every link are read, --heat seconds are
+ * waited and they are read again.  Each sweep keeps up to --max-mads
+ * PortCountersExtended queries in flight and each end's interval is timed
+ * from its own replies, so a slow sweep does not skew the rate.  A port
+ * without PortCountersExtended is left unsampled as the 32 bit counters
+ * saturate in seconds on a busy link.
+ */
+struct heat_sample {
+	int idx;
+	int pnum;
+	uint64_t xmit[2];	/* the first and second read */
+	uint64_t rcv[2];
+	double when[2];
+	int ok;			/* both reads answered */
+};
+
+static double now_secs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+/* sample the end of a link to read: the switch end, else the lower one */
+static int heat_end(int idx, int pnum, int rem_idx, int rem_pnum)
+{
+	int sw = lfab.nodes[idx]->type == IB_NODE_SWITCH;
+	int rem_sw = lfab.nodes[rem_idx]->type == IB_NODE_SWITCH;
+
+	if (sw != rem_sw)
+		return (sw);
+	return (idx < rem_idx || (idx == rem_idx && pnum < rem_pnum));
+}
+
+static void heat_read(mad_req_t *req, void *arg)
+{
+	struct heat_sample *hs = req->ctx;
+	int pass = *(int *)arg;
+
+	hs->when[pass] = now_secs();
+	hs->ok = req->ok;
+	if (req->ok) {
+		hs->xmit[pass] = mad_get_field64(req->data, 0,
+						 IB_PC_EXT_XMT_BYTES_F);
+		hs->rcv[pass] = mad_get_field64(req->data, 0,
+						IB_PC_EXT_RCV_BYTES_F);
+	}
+}
+
+/* read the counters of every sample still ok */
+static void read_samples(struct heat_sample *hs, int num, mad_req_t *reqs,
+			 int pass)
+{
+	ibnd_node_t *node;
+	int i, n = 0;
+
+	for (i = 0; i < num; i++) {
+		if (pass && !hs[i].ok)
+			continue;
+		node = lfab.nodes[hs[i].idx];
+		mad_req_pma(&reqs[n++], node->type == IB_NODE_SWITCH
+				? node->smalid
+				: node->ports[hs[i].pnum]->base_lid,
+			    hs[i].pnum, IB_GSI_PORT_COUNTERS_EXT, &hs[i]);
+	}
+	mad_window_run(ibmad_port, reqs, n, max_mads, heat_read, &pass);
+}
+
+static void sample_heat(void)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *rem_port;
+	struct heat_sample *hs = NULL;
+	mad_req_t *reqs;
+	int num = 0, size = 0, idx, rem_idx, pnum, i, failed = 0;
+	unsigned bit;
+	uint64_t bytes;
+	double secs;
+	int mbps;
+
+	stats_push("heat");
+	lfab.util = malloc((lfab.num_port_bits + 1) * sizeof(*lfab.util));
+	if (!lfab.util) {
+		fprintf(stderr, "ERROR: failed to allocate utilization\n");
+		exit(1);
+	}
+	for (bit = 0; bit < lfab.num_port_bits; bit++)
+		lfab.util[bit] = -1;
+
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		node = lfab.nodes[idx];
+		if (!node_drawn(idx))
+			continue;
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (!node->ports[pnum])
+				continue;
+			rem_port = node->ports[pnum]->remoteport;
+			if (!rem_port)
+				continue;
+			rem_idx = guid_index_lookup(lfab.index,
+						    rem_port->node->guid);
+			if (rem_idx < 0 || !node_drawn(rem_idx)
+			    || !heat_end(idx, pnum, rem_idx,
+					 rem_port->portnum))
+				continue;
+			if (num == size) {
+				size = size ? size * 2 : 1024;
+				hs = realloc(hs, size * sizeof(*hs));
+				if (!hs) {
+					fprintf(stderr, "ERROR: failed to "
+						"allocate samples\n");
+					exit(1);
+				}
+			}
+			hs[num].idx = idx;
+			hs[num].pnum = pnum;
+			hs[num].ok = 0;
+			num++;
+		}
+	}
+	if ((reqs = malloc((num + 1) * sizeof(*reqs))) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate samples\n");
+		exit(1);
+	}
+
+	read_samples(hs, num, reqs, 0);
+	sleep(heat_secs);
+	read_samples(hs, num, reqs, 1);
+
+	for (i = 0; i < num; i++) {
+		node = lfab.nodes[hs[i].idx];
+		secs = hs[i].when[1] - hs[i].when[0];
+		mbps = port_data_mbps(node->ports[hs[i].pnum]);
+		if (!hs[i].ok || secs <= 0 || !mbps) {
+			failed++;
+			continue;
+		}
+
+		/* the counters are in units of 4 octets; the busier
+		 * direction sets the color */
+		bytes = hs[i].xmit[1] - hs[i].xmit[0];
+		if (hs[i].rcv[1] - hs[i].rcv[0] > bytes)
+			bytes = hs[i].rcv[1] - hs[i].rcv[0];
+		bytes *= 4;
+
+		rem_port = node->ports[hs[i].pnum]->remoteport;
+		rem_idx = guid_index_lookup(lfab.index, rem_port->node->guid);
+		bit = lfab.port_base[hs[i].idx] + hs[i].pnum;
+		lfab.util[bit] = bytes * 8 / secs / (mbps * 1000000.0);
+		if (lfab.util[bit] > 1)
+			lfab.util[bit] = 1;
+		lfab.util[lfab.port_base[rem_idx] + rem_port->portnum] =
+			lfab.util[bit];
+	}
+	if (failed)
+		fprintf(stderr, "WARNING: %d of %d links could not be "
+			"sampled\n", failed, num);
+
+	free(reqs);
+	free(hs);
+	stats_set("heat_ports", num);
+	stats_pop();
+}
+
+static inline float port_util(int idx, int portnum)
+{
+	return (lfab.util ? lfab.util[lfab.port_base[idx] + portnum] : -1);
+}
+
+/** =========================================================================
+ * Layered layout
+ *
+ * Nodes are put in tiers: with -r the roots are the top tier and every other
+ * node is a tier below the nearest root; otherwise CAs are the bottom tier
+ * and every switch is a tier above the nearest CA.  The bottom tier is
+ * ordered as the fabric lists it and each tier above it by the mean position
+ * of its neighbours below (one barycenter sweep), which keeps a fat tree's
+ * edges short without the crossing minimization dot would do.
+ */
+#define LAYOUT_XSEP 72		/* points between nodes of the widest tier */
+#define LAYOUT_YSEP 144		/* points between tiers */
+
+static double *layout_key;
+
+static int layout_cmp(const void *a, const void *b)
+{
+	int ia = *(const int *)a;
+	int ib = *(const int *)b;
+
+	if (layout_key[ia] != layout_key[ib])
+		return (layout_key[ia] < layout_key[ib] ? -1 : 1);
+	return (ia - ib);
+}
+
+/* BFS from the nodes queued in q[0..tail) over the drawn nodes; with
+ * switches_only CAs are not passed through.  Returns the greatest depth.
+ */
+static int layout_bfs(int *depth, int *q, int tail, int switches_only)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *rem_port;
+	int head = 0, max = 0, idx, rem_idx, pnum;
+
+	while (head < tail) {
+		idx = q[head++];
+		node = lfab.nodes[idx];
+		if (depth[idx] > max)
+			max = depth[idx];
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (!node->ports[pnum])
+				continue;
+			rem_port = node->ports[pnum]->remoteport;
+			if (!rem_port)
+				continue;
+			if (switches_only
+			    && rem_port->node->type != IB_NODE_SWITCH)
+				continue;
+			rem_idx = guid_index_lookup(lfab.index,
+						    rem_port->node->guid);
+			if (rem_idx < 0 || depth[rem_idx] >= 0
+			    || !node_drawn(rem_idx))
+				continue;
+			depth[rem_idx] = depth[idx] + 1;
+			q[tail++] = rem_idx;
+		}
+	}
+	return (max);
+}
+
+static void layout_fabric(void)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *rem_port;
+	int *tier, *order, *start, *q;
+	int n = lfab.num_nodes;
+	int idx, rem_idx, pnum, t, i, tail = 0, max, num_tiers, widest = 0;
+	double sum;
+	int cnt;
+
+	tier = malloc((n + 1) * sizeof(*tier));
+	order = malloc((n + 1) * sizeof(*order));
+	q = malloc((n + 1) * sizeof(*q));
+	layout_key = calloc(n + 1, sizeof(*layout_key));
+	lfab.x = calloc(n + 1, sizeof(*lfab.x));
+	lfab.y = calloc(n + 1, sizeof(*lfab.y));
+	if (!tier || !order || !q || !layout_key || !lfab.x || !lfab.y) {
+		fprintf(stderr, "ERROR: failed to allocate layout\n");
+		exit(1);
+	}
+	for (idx = 0; idx < n; idx++)
+		tier[idx] = -1;
+
+	if (lfab.num_roots) {
+		for (i = 0; i < lfab.num_roots; i++) {
+			tier[lfab.roots[i]] = 0;
+			q[tail++] = lfab.roots[i];
+		}
+		max = layout_bfs(tier, q, tail, 0);
+		/* roots on top; anything not reached goes on the bottom */
+		for (idx = 0; idx < n; idx++)
+			tier[idx] = tier[idx] < 0 ? 0 : max - tier[idx];
+	} else {
+		for (idx = 0; idx < n; idx++) {
+			if (lfab.nodes[idx]->type == IB_NODE_SWITCH
+			    || node_ignored(idx))
+				continue;
+			/* folded CAs are not drawn but still seed the tiers */
+			tier[idx] = 0;
+			q[tail++] = idx;
+		}
+		max = layout_bfs(tier, q, tail, 1);
+		/* anything not reached goes on the top */
+		for (idx = 0; idx < n; idx++)
+			if (tier[idx] < 0)
+				tier[idx] = max + 1;
+		max++;
+	}
+	num_tiers = max + 1;
+
+	/* bucket the drawn nodes by tier, in index order */
+	start = calloc(num_tiers + 1, sizeof(*start));
+	if (!start) {
+		fprintf(stderr, "ERROR: failed to allocate layout\n");
+		exit(1);
+	}
+	for (idx = 0; idx < n; idx++)
+		if (node_drawn(idx))
+			start[tier[idx] + 1]++;
+	for (t = 0; t < num_tiers; t++) {
+		if (start[t + 1] > widest)
+			widest = start[t + 1];
+		start[t + 1] += start[t];
+	}
+	for (idx = 0; idx < n; idx++)
+		if (node_drawn(idx))
+			order[start[tier[idx]]++] = idx;
+	/* the fill moved each start up to the next */
+	for (t = num_tiers; t > 0; t--)
+		start[t] = start[t - 1];
+	start[0] = 0;
+
+	for (t = 0; t < num_tiers; t++) {
+		int first = start[t], num = start[t + 1] - start[t];
+
+		if (t > 0) {
+			for (i = first; i < first + num; i++) {
+				idx = order[i];
+				node = lfab.nodes[idx];
+				sum = 0;
+				cnt = 0;
+				for (pnum = 1; pnum <= node->numports; pnum++) {
+					if (!node->ports[pnum])
+						continue;
+					rem_port = node->ports[pnum]->remoteport;
+					if (!rem_port)
+						continue;
+					rem_idx = guid_index_lookup(lfab.index,
+							rem_port->node->guid);
+					if (rem_idx < 0 || !node_drawn(rem_idx)
+					    || tier[rem_idx] >= t)
+						continue;
+					sum += lfab.x[rem_idx];
+					cnt++;
+				}
+				/* nothing below; keep to the fabric order */
+				layout_key[idx] = cnt ? sum / cnt
+					: (double)(i - first) * widest
+					  * LAYOUT_XSEP / num;
+			}
+			qsort(&order[first], num, sizeof(*order), layout_cmp);
+		}
+		for (i = 0; i < num; i++) {
+			idx = order[first + i];
+			lfab.x[idx] = (int)((i + 0.5) * widest * LAYOUT_XSEP
+					    / num);
+			lfab.y[idx] = (tier[idx] + 1) * LAYOUT_YSEP;
+		}
+	}
+
+	free(start);
+	free(layout_key);
+	layout_key = NULL;
+	free(q);
+	free(order);
+	free(tier);
+}
+
+/** =========================================================================
+ * DOT output
+ *
+ * Edges are the bulk of the output on a large fabric so their lines are
+ * formatted by hand and appended to dot_out rather than printf'ed.
+ */
+static outbuf_t dot_out;
+
+#define GUID_STR_LEN 17		/* 'x' and 16 hex digits */
+
+static char *put_guid(char *p, uint64_t guid)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	*p++ = 'x';
+	for (i = 60; i >= 0; i -= 4)
+		*p++ = hex[(guid >> i) & 0xf];
+	return (p);
 }
 
-static void add_to_leafs(ibnd_node_t *node)
+static char *put_int(char *p, int val)
 {
-	struct lnode *lnode = calloc(1, sizeof(*lnode));
-	if (!lnode) {
-		fprintf(stderr, "%s:%d calloc FAILED! (%s)\n",
-			__FUNCTION__, __LINE__, strerror(errno));
-		return;
-	}
-	lnode->node = node;
-	if (lfab.leafs)
-		lnode->next = lfab.leafs;
-	lfab.leafs = lnode;
+	char tmp[12];
+	unsigned v = val < 0 ? -(unsigned)val : (unsigned)val;
+	int n = 0;
+
+	if (val < 0)
+		*p++ = '-';
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n)
+		*p++ = tmp[--n];
+	return (p);
 }
 
-static int ignore_node(char *node_name)
+static char *put_str(char *p, const char *str, size_t len)
 {
-	int rc;
-	static regex_t exp;
-	static int regex_compiled = 0;
-	static int regex_failed = 0;
+	memcpy(p, str, len);
+	return (p + len);
+}
+#define PUT_LIT(p, lit) put_str(p, lit, sizeof(lit) - 1)
 
-	if (!ignore_regex || regex_failed)
-		return 0;
+/* guid_str is the tail node's GUID as made by put_guid() */
+static void dot_edge(const char *guid_str, struct links *link)
+{
+	char line[160];
+	char *p = line;
 
-	if (!regex_compiled) { /* only compile it one time */
-		if ((rc = regcomp(&exp, ignore_regex, REG_ICASE |
-				REG_NOSUB | REG_EXTENDED)) != 0) {
-			fprintf(stderr, "ERROR: regcomp failed on \"%s\": %d\n",
-				root_regex, rc);
-			regex_failed = 1;
-			return 0;
-		}
-		regex_compiled = 1;
+	p = PUT_LIT(p, "   ");
+	p = put_str(p, guid_str, GUID_STR_LEN);
+	p = PUT_LIT(p, " -> ");
+	p = put_guid(p, link->rem_guid);
+	if (link->combine_num > 1) {
+		p = PUT_LIT(p, " [label=\"");
+		p = put_int(p, link->combine_num);
+		p = PUT_LIT(p, "\", arrowhead=\"none\"");
+		if (!link->routed && link->util < 0)
+			p = PUT_LIT(p, ", color=\"blue\"");
+	} else {
+		p = PUT_LIT(p, " [taillabel=\"");
+		p = put_int(p, link->pnum);
+		p = PUT_LIT(p, "\", headlabel=\"");
+		p = put_int(p, link->rem_pnum);
+		p = PUT_LIT(p, "\", arrowhead=\"none\"");
 	}
+	/* routes over heat; heat goes green (idle) to red (saturated) */
+	if (link->routed)
+		p = PUT_LIT(p, ", color=\"red\", penwidth=\"2\"");
+	else if (link->util >= 0)
+		p += sprintf(p, ", color=\"%.3f 1.000 1.000\", "
+			     "penwidth=\"%.1f\"", (1 - link->util) / 3,
+			     1 + 4 * link->util);
+	p = PUT_LIT(p, "];\n");
+	outbuf_append(&dot_out, line, p - line);
+}
 
-	return (regexec(&exp, node_name, 0, NULL, 0) == 0);
+/* the aggregate of the CAs folded in to a switch and its edge; hosts with
+ * several CAs are named once but each CA is counted
+ */
+static void dot_cas(const char *guid_str, int idx)
+{
+	hostlist_t hl = lfab.cas[idx];
+	int count = lfab.ca_count[idx];
+
+	hostlist_uniq(hl);
+	outbuf_printf(&dot_out, "   %s_cas [label=\"", guid_str);
+	hostlist_ranged_write(hl, outbuf_write_cb, &dot_out);
+	outbuf_printf(&dot_out, "\\n%d CA%s\"", count, count == 1 ? "" : "s");
+	/* below its switch, half a tier down */
+	if (lfab.x)
+		outbuf_printf(&dot_out, ", pos=\"%d,%d\"", lfab.x[idx],
+			      lfab.y[idx] - LAYOUT_YSEP / 2);
+	outbuf_puts(&dot_out, "];\n");
+	outbuf_printf(&dot_out, "   %s -> %s_cas [label=\"%d\", "
+		      "arrowhead=\"none\"];\n", guid_str, guid_str,
+		      lfab.ca_links[idx]);
 }
 
-struct links {
-	uint8_t pnum;
-	uint64_t rem_guid;
-	uint8_t rem_pnum;
-	int combine_num;
-};
+/* "<guid>; \n" lines of a rank group, most recently found first */
+static void dot_rank(const char *rank, int *idxs, int num)
+{
+	char line[32];
+	char *p;
 
-static void process_node(ibnd_node_t *node, void *data)
+	outbuf_printf(&dot_out, "{rank=%s; ", rank);
+	while (num--) {
+		p = put_guid(line, lfab.nodes[idxs[num]]->guid);
+		p = PUT_LIT(p, "; \n");
+		outbuf_append(&dot_out, line, p - line);
+	}
+	outbuf_puts(&dot_out, "}\n");
+}
+
+static void process_node(int idx)
 {
 	static regex_t exp;
 	static int regex_compiled = 0;
 	char re_str[256];
 
+	ibnd_node_t *node = lfab.nodes[idx];
 	int rc, pnum, i;
 	char label[256];
 	char attr[256];
-	char *node_name = NULL;
+	char guid_str[GUID_STR_LEN + 1];
+	const char *node_name = NULL;
 	attr[0] = '\0';
 	ibnd_port_t *rem_port = NULL;
-	struct links links[256];
+	struct links *links = lfab.links;
 	int num_links = 0;
 
-	node_name = remap_node_name(node_name_map,
-					node->guid,
-					node->nodedesc);
-
-	if (ignore_node(node_name))
+	if (node_ignored(idx) || node_collapsed(idx))
 		return;
+	node_name = lfab.names[idx];
 
-	id_root(node, node_name);
+	if (lfab.x)
+		snprintf(attr, 256, ", pos=\"%d,%d\"", lfab.x[idx],
+			 lfab.y[idx]);
 
 	if (!regex_compiled && cluster_name) { /* only compile it one time */
 		snprintf(re_str, 256, "^%s.*$", cluster_name);
@@ -244,12 +1446,14 @@ static void process_node(ibnd_node_t *node, void *data)
 	if (regex_compiled && cluster_name
 	    && (regexec(&exp, node_name, 0, NULL, 0) == 0)) {
 		snprintf(label, 256, "%s", node_name);
-		add_to_leafs(node);
+		lfab.leafs[lfab.num_leafs++] = idx;
 	} else
 		snprintf(label, 256, "%s\\nG: x%016lx", node_name, node->guid);
 
 	label[255] = '\0';
-	printf("   x%016lx [label=\"%s\"%s];\n", node->guid, label, attr);
+	*put_guid(guid_str, node->guid) = '\0';
+	outbuf_printf(&dot_out, "   %s [label=\"%s\"%s];\n", guid_str, label,
+		      attr);
 
 	for (pnum = 1; pnum <= node->numports; pnum++) {
 		if (!node->ports[pnum])
@@ -257,88 +1461,727 @@ static void process_node(ibnd_node_t *node, void *data)
 		rem_port = node->ports[pnum]->remoteport;
 		if (!rem_port)
 			continue;
-		if (!port_flagged(node->guid, pnum)) {
-			char *rem_node_name = remap_node_name(node_name_map,
-							rem_port->node->guid,
-							rem_port->node->nodedesc);
-			if (ignore_node(rem_node_name)) {
-				free(rem_node_name);
+		if (!port_flagged(idx, pnum)) {
+			int rem_idx = guid_index_lookup(lfab.index,
+							rem_port->node->guid);
+
+			/* ibnetdisc lists every node it links to */
+			if (rem_idx < 0 || node_ignored(rem_idx)
+			    || node_collapsed(rem_idx))
 				continue;
-			}
-			free(rem_node_name);
 
-			flag_port(rem_port->node, rem_port->portnum);
+			flag_port(rem_idx, rem_port->portnum);
 			if (combine_edges) {
-				int f = 0;
-				for (i = 0; i < num_links; i++)
-					if (links[i].rem_guid == rem_port->node->guid) {
-						links[i].combine_num++;
-						f = 1;
-						break;
-					}
-				if (f)
+				if (lfab.link_owner[rem_idx] == idx) {
+					i = lfab.link_slot[rem_idx];
+					links[i].combine_num++;
+					links[i].routed |= port_routed(idx,
+								       pnum);
+					if (port_util(idx, pnum)
+					    > links[i].util)
+						links[i].util =
+							port_util(idx, pnum);
 					continue;
+				}
+				lfab.link_owner[rem_idx] = idx;
+				lfab.link_slot[rem_idx] = num_links;
 			}
 			links[num_links].pnum = pnum;
 			links[num_links].rem_guid = rem_port->node->guid;
 			links[num_links].rem_pnum = rem_port->portnum;
 			links[num_links].combine_num = 1;
+			links[num_links].routed = port_routed(idx, pnum);
+			links[num_links].util = port_util(idx, pnum);
 			num_links++;
 		}
 	}
 
-	for (i = 0; i < num_links; i++) {
-		if (links[i].combine_num > 1) {
-			printf("   x%016lx -> x%016lx [label=\"%d\", "
-				"arrowhead=\"none\", color=\"blue\"];\n",
-				node->guid, links[i].rem_guid,
-				links[i].combine_num);
+	for (i = 0; i < num_links; i++)
+		dot_edge(guid_str, &links[i]);
+
+	if (lfab.cas && lfab.cas[idx])
+		dot_cas(guid_str, idx);
+}
+
+static int print_dot_file(ibnd_fabric_t *fabric)
+{
+	int rc, idx;
+
+	index_fabric(fabric);
+	name_nodes();
+	if (scope_hosts)
+		scope_fabric();
+	if (collapse_leaves)
+		collapse_cas();
+	find_roots();
+	if (num_routes)
+		trace_routes();
+	if (heat_secs)
+		sample_heat();
+	if (layout)
+		layout_fabric();
+	lfab.rank_sep = 1 + ((lfab.num_nodes - lfab.num_folded) * 0.5/10);
+
+	outbuf_init(&dot_out, stdout);
+	outbuf_puts(&dot_out, "digraph G {\n");
+	outbuf_puts(&dot_out, "   node [shape=record, fontsize=9];\n");
+	outbuf_printf(&dot_out, "   graph [outputorder=nodesfirst, "
+		      "ranksep=\"%d equally\"];\n", lfab.rank_sep);
+
+	for (idx = 0; idx < lfab.num_nodes; idx++)
+		process_node(idx);
+
+	if (lfab.num_roots)
+		dot_rank("min", lfab.roots, lfab.num_roots);
+	if (lfab.num_leafs)
+		dot_rank("max", lfab.leafs, lfab.num_leafs);
+
+	outbuf_puts(&dot_out, "}\n");
+
+	if ((rc = outbuf_flush(&dot_out)) != 0)
+		fprintf(stderr, "ERROR: failed to write dot file: %s\n",
+			strerror(errno));
+	outbuf_free(&dot_out);
+	free_index();
+	return (rc);
+}
+
+/** =========================================================================
+ * Fabric diff
+ *
+ * Nodes and links of the graphed fabric are joined with those of an older
+ * snapshot on GUID and port number.  Only what changed is drawn: added
+ * nodes and links in green, removed ones dashed red, links whose ends were
+ * cabled elsewhere in blue and links whose width or speed changed in
+ * orange.  A tab separated record of each change goes to stderr.
+ */
+enum diff_type {
+	DIFF_ADDED,
+	DIFF_REMOVED,
+	DIFF_MOVED,
+	DIFF_CHANGED
+};
+
+static const char *diff_names[] = { "added", "removed", "moved", "changed" };
+static const char *diff_colors[] = {
+	"color=\"green\"",
+	"color=\"red\", style=\"dashed\"",
+	"color=\"blue\"",
+	"color=\"orange\""
+};
+
+struct diff_link {
+	enum diff_type type;
+	ibnd_port_t *port;		/* the end with the lower GUID */
+	ibnd_port_t *rem_port;
+	ibnd_port_t *old_port;		/* DIFF_CHANGED: port before */
+};
+
+struct fabric_diff {
+	guid_index_t *old_index;	/* old node GUID to old_nodes index */
+	ibnd_node_t **old_nodes;
+	int num_old;
+	struct diff_link *links;
+	int num_links;
+	int size_links;
+	guid_index_t *drawn;		/* GUIDs of the nodes to draw */
+	ibnd_node_t **draw;
+	int num_draw;
+} fdiff;
+
+static ibnd_node_t *old_node(uint64_t guid)
+{
+	int i = guid_index_lookup(fdiff.old_index, guid);
+
+	return (i < 0 ? NULL : fdiff.old_nodes[i]);
+}
+
+static ibnd_node_t *new_node(uint64_t guid)
+{
+	int i = guid_index_lookup(lfab.index, guid);
+
+	return (i < 0 ? NULL : lfab.nodes[i]);
+}
+
+/* the remote end of port pnum of node; NULL if none */
+static ibnd_port_t *remote_of(ibnd_node_t *node, int pnum)
+{
+	if (!node || pnum > node->numports || !node->ports[pnum])
+		return (NULL);
+	return (node->ports[pnum]->remoteport);
+}
+
+/* each link once, from its lower end */
+static int link_end(ibnd_port_t *port, ibnd_port_t *rem_port)
+{
+	return (port->node->guid < rem_port->node->guid
+		|| (port->node->guid == rem_port->node->guid
+		    && port->portnum < rem_port->portnum));
+}
+
+static int same_link(ibnd_port_t *a, ibnd_port_t *b)
+{
+	return (a && b && a->node->guid == b->node->guid
+		&& a->portnum == b->portnum);
+}
+
+static void draw_node(ibnd_node_t *node)
+{
+	if (guid_index_lookup(fdiff.drawn, node->guid) >= 0)
+		return;
+	if (guid_index_insert(fdiff.drawn, node->guid, fdiff.num_draw)) {
+		fprintf(stderr, "ERROR: failed to allocate diff\n");
+		exit(1);
+	}
+	fdiff.draw[fdiff.num_draw++] = node;
+}
+
+static void add_diff(enum diff_type type, ibnd_port_t *port,
+		     ibnd_port_t *rem_port, ibnd_port_t *old_port)
+{
+	struct diff_link *dl;
+
+	if (fdiff.num_links == fdiff.size_links) {
+		int size = fdiff.size_links ? fdiff.size_links * 2 : 256;
+		dl = realloc(fdiff.links, size * sizeof(*dl));
+		if (!dl) {
+			fprintf(stderr, "ERROR: failed to allocate diff\n");
+			exit(1);
+		}
+		fdiff.links = dl;
+		fdiff.size_links = size;
+	}
+	dl = &fdiff.links[fdiff.num_links++];
+	dl->type = type;
+	dl->port = port;
+	dl->rem_port = rem_port;
+	dl->old_port = old_port;
+	draw_node(port->node);
+	draw_node(rem_port->node);
+}
+
+/* "4xQDR" */
+static const char *link_rate(ibnd_port_t *port, char *buf, size_t n)
+{
+	snprintf(buf, n, "%s%s", port_width_str(port), port_speed_str(port));
+	return (buf);
+}
+
+/* width, or speed from either LinkSpeedActive or LinkSpeedExtActive */
+static int rate_changed(ibnd_port_t *a, ibnd_port_t *b)
+{
+	return (port_lanes(a) != port_lanes(b)
+		|| port_lane_mbps(a) != port_lane_mbps(b));
+}
+
+static void diff_fabrics(ibnd_fabric_t *old)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *rem_port, *old_rem, *new_rem;
+	int i, pnum;
+
+	for (node = old->nodes; node; node = node->next)
+		fdiff.num_old++;
+	fdiff.old_index = guid_index_create(fdiff.num_old);
+	fdiff.old_nodes = calloc(fdiff.num_old + 1, sizeof(*fdiff.old_nodes));
+	fdiff.drawn = guid_index_create(1024);
+	fdiff.draw = calloc(lfab.num_nodes + fdiff.num_old + 1,
+			    sizeof(*fdiff.draw));
+	if (!fdiff.old_index || !fdiff.old_nodes || !fdiff.drawn
+	    || !fdiff.draw) {
+		fprintf(stderr, "ERROR: failed to allocate diff\n");
+		exit(1);
+	}
+	for (i = 0, node = old->nodes; node; i++, node = node->next) {
+		fdiff.old_nodes[i] = node;
+		if (guid_index_insert(fdiff.old_index, node->guid, i)) {
+			fprintf(stderr, "ERROR: failed to allocate diff\n");
+			exit(1);
+		}
+	}
+
+	/* links now; added, moved or changed */
+	for (i = 0; i < lfab.num_nodes; i++) {
+		node = lfab.nodes[i];
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (!(rem_port = remote_of(node, pnum))
+			    || !link_end(node->ports[pnum], rem_port))
+				continue;
+			old_rem = remote_of(old_node(node->guid), pnum);
+			if (same_link(old_rem, rem_port)) {
+				if (rate_changed(node->ports[pnum],
+						 old_rem->remoteport))
+					add_diff(DIFF_CHANGED,
+						 node->ports[pnum], rem_port,
+						 old_rem->remoteport);
+				continue;
+			}
+			add_diff(old_rem || remote_of(old_node(
+					rem_port->node->guid),
+					rem_port->portnum)
+				 ? DIFF_MOVED : DIFF_ADDED,
+				 node->ports[pnum], rem_port, NULL);
+		}
+	}
+
+	/* links then; removed */
+	for (i = 0; i < fdiff.num_old; i++) {
+		node = fdiff.old_nodes[i];
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (!(rem_port = remote_of(node, pnum))
+			    || !link_end(node->ports[pnum], rem_port))
+				continue;
+			new_rem = remote_of(new_node(node->guid), pnum);
+			if (!same_link(new_rem, rem_port))
+				add_diff(DIFF_REMOVED, node->ports[pnum],
+					 rem_port, NULL);
+		}
+	}
+
+	/* nodes with no link to report */
+	for (i = 0; i < lfab.num_nodes; i++)
+		if (!old_node(lfab.nodes[i]->guid))
+			draw_node(lfab.nodes[i]);
+	for (i = 0; i < fdiff.num_old; i++)
+		if (!new_node(fdiff.old_nodes[i]->guid))
+			draw_node(fdiff.old_nodes[i]);
+}
+
+static void report_diff(FILE *fp)
+{
+	struct diff_link *dl;
+	ibnd_node_t *node;
+	char now[16], then[16];
+	int i;
+
+	for (i = 0; i < fdiff.num_draw; i++) {
+		node = fdiff.draw[i];
+		if (old_node(node->guid) && new_node(node->guid))
+			continue;
+		fprintf(fp, "node\t%s\t0x%016" PRIx64 "\t%s\n",
+			new_node(node->guid) ? "added" : "removed",
+			node->guid, nnmap_name(node_name_map, node->guid,
+					       node->nodedesc));
+	}
+	for (i = 0; i < fdiff.num_links; i++) {
+		dl = &fdiff.links[i];
+		fprintf(fp, "link\t%s\t0x%016" PRIx64 "\t%d\t0x%016" PRIx64
+			"\t%d", diff_names[dl->type], dl->port->node->guid,
+			dl->port->portnum, dl->rem_port->node->guid,
+			dl->rem_port->portnum);
+		if (dl->type == DIFF_CHANGED)
+			fprintf(fp, "\t%s\t%s",
+				link_rate(dl->old_port, then, sizeof(then)),
+				link_rate(dl->port, now, sizeof(now)));
+		fprintf(fp, "\n");
+	}
+}
+
+static int write_diff_summary(void)
+{
+	FILE *fp = fopen(diff_summary_file, "w");
+	int err;
+
+	if (!fp) {
+		fprintf(stderr, "ERROR: failed to open \"%s\": %s\n",
+			diff_summary_file, strerror(errno));
+		return (-1);
+	}
+	report_diff(fp);
+	err = ferror(fp);
+	if (fclose(fp) || err) {
+		fprintf(stderr, "ERROR: failed to write \"%s\": %s\n",
+			diff_summary_file, strerror(errno));
+		return (-1);
+	}
+	return (0);
+}
+
+static int print_diff_file(ibnd_fabric_t *fabric, ibnd_fabric_t *old)
+{
+	struct diff_link *dl;
+	ibnd_node_t *node;
+	char guid_str[GUID_STR_LEN + 1];
+	char now[16], then[16];
+	const char *attr;
+	int i, rc;
+
+	index_fabric(fabric);
+	name_nodes();
+	stats_push("diff");
+	diff_fabrics(old);
+	stats_pop();
+
+	outbuf_init(&dot_out, stdout);
+	outbuf_puts(&dot_out, "digraph G {\n");
+	outbuf_puts(&dot_out, "   node [shape=record, fontsize=9];\n");
+
+	for (i = 0; i < fdiff.num_draw; i++) {
+		node = fdiff.draw[i];
+		if (!old_node(node->guid))
+			attr = ", color=\"green\"";
+		else if (!new_node(node->guid))
+			attr = ", color=\"red\", style=\"dashed\"";
+		else
+			attr = "";
+		*put_guid(guid_str, node->guid) = '\0';
+		outbuf_printf(&dot_out, "   %s [label=\"%s\\nG: %s\"%s];\n",
+			      guid_str, nnmap_name(node_name_map, node->guid,
+						   node->nodedesc),
+			      guid_str, attr);
+	}
+
+	for (i = 0; i < fdiff.num_links; i++) {
+		dl = &fdiff.links[i];
+		*put_guid(guid_str, dl->port->node->guid) = '\0';
+		outbuf_printf(&dot_out, "   %s -> x%016" PRIx64 " [taillabel="
+			      "\"%d\", headlabel=\"%d\", arrowhead=\"none\", "
+			      "%s", guid_str, dl->rem_port->node->guid,
+			      dl->port->portnum, dl->rem_port->portnum,
+			      diff_colors[dl->type]);
+		if (dl->type == DIFF_CHANGED)
+			outbuf_printf(&dot_out, ", label=\"%s -> %s\"",
+				      link_rate(dl->old_port, then,
+						sizeof(then)),
+				      link_rate(dl->port, now, sizeof(now)));
+		outbuf_puts(&dot_out, "];\n");
+	}
+	outbuf_puts(&dot_out, "}\n");
+
+	if ((rc = outbuf_flush(&dot_out)) != 0)
+		fprintf(stderr, "ERROR: failed to write dot file: %s\n",
+			strerror(errno));
+	outbuf_free(&dot_out);
+
+	if (diff_summary_file && write_diff_summary())
+		rc = -1;
+	stats_set("changes", fdiff.num_links);
+
+	guid_index_destroy(fdiff.old_index);
+	guid_index_destroy(fdiff.drawn);
+	free(fdiff.old_nodes);
+	free(fdiff.draw);
+	free(fdiff.links);
+	free_index();
+	return (rc);
+}
+
+/** =========================================================================
+ * Export formats
+ *
+ * The fabric less the nodes matched by -i, for analysis rather than
+ * drawing.  Exported nodes are numbered 0..n-1 in fabric order; each link
+ * carries the port numbers at both ends and its active width (lanes: 1, 2,
+ * 4, 8 or 12) and lane rate (Mb/s signalling, from LinkSpeedExtActive for
+ * FDR and faster, e.g. 10000 for QDR and 25781 for EDR); either is 0 when
+ * not known.
+ */
+static int *export_id;		/* by index; -1 if not exported */
+static int num_export;
+
+static void number_export(void)
+{
+	int idx;
+
+	export_id = malloc((lfab.num_nodes + 1) * sizeof(*export_id));
+	if (!export_id) {
+		fprintf(stderr, "ERROR: failed to allocate export\n");
+		exit(1);
+	}
+	for (idx = 0, num_export = 0; idx < lfab.num_nodes; idx++)
+		export_id[idx] = node_ignored(idx) ? -1 : num_export++;
+}
+
+/* the exported id of the remote end of port pnum of node idx; -1 if none */
+static int export_rem(int idx, int pnum)
+{
+	ibnd_port_t *rem_port = remote_of(lfab.nodes[idx], pnum);
+	int rem_idx;
+
+	if (!rem_port)
+		return (-1);
+	rem_idx = guid_index_lookup(lfab.index, rem_port->node->guid);
+	return (rem_idx < 0 ? -1 : export_id[rem_idx]);
+}
+
+static const char *node_type_str(ibnd_node_t *node)
+{
+	switch (node->type) {
+		case IB_NODE_SWITCH: return ("switch");
+		case IB_NODE_CA: return ("ca");
+		case IB_NODE_ROUTER: return ("router");
+	}
+	return ("unknown");
+}
+
+static void put_json_string(const char *str)
+{
+	const unsigned char *c;
+
+	outbuf_putc(&dot_out, '"');
+	for (c = (const unsigned char *)str; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			outbuf_putc(&dot_out, '\\');
+			outbuf_putc(&dot_out, *c);
+		} else if (*c < 0x20) {
+			outbuf_printf(&dot_out, "\\u%04x", *c);
 		} else {
-			printf("   x%016lx -> x%016lx "
-				"[taillabel=\"%d\", headlabel=\"%d\", "
-				"arrowhead=\"none\"];\n",
-				node->guid, links[i].rem_guid,
-				links[i].pnum, links[i].rem_pnum);
+			outbuf_putc(&dot_out, *c);
 		}
 	}
+	outbuf_putc(&dot_out, '"');
+}
+
+/* networkx node-link format */
+static void write_json(void)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *port;
+	int idx, pnum, first = 1;
+
+	outbuf_puts(&dot_out, "{\"directed\": false, \"multigraph\": true, "
+		    "\"graph\": {},\n \"nodes\": [");
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		node = lfab.nodes[idx];
+		outbuf_printf(&dot_out, "%s\n  {\"id\": %d, \"guid\": \"0x%016"
+			      PRIx64 "\", \"type\": \"%s\", \"ports\": %d, "
+			      "\"name\": ", first ? "" : ",", export_id[idx],
+			      node->guid, node_type_str(node), node->numports);
+		put_json_string(lfab.names[idx]);
+		outbuf_putc(&dot_out, '}');
+		first = 0;
+	}
 
-	free(node_name);
+	outbuf_puts(&dot_out, "\n ],\n \"links\": [");
+	first = 1;
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		node = lfab.nodes[idx];
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (export_rem(idx, pnum) < 0)
+				continue;
+			port = node->ports[pnum];
+			if (!link_end(port, port->remoteport))
+				continue;
+			outbuf_printf(&dot_out, "%s\n  {\"source\": %d, "
+				      "\"source_port\": %d, \"target\": %d, "
+				      "\"target_port\": %d, \"width\": %d, "
+				      "\"lane_mbps\": %d}", first ? "" : ",",
+				      export_id[idx], pnum,
+				      export_rem(idx, pnum),
+				      port->remoteport->portnum,
+				      port_lanes(port), port_lane_mbps(port));
+			first = 0;
+		}
+	}
+	outbuf_puts(&dot_out, "\n ]\n}\n");
 }
 
-static void print_dot_file(ibnd_fabric_t *fabric)
+static void put_xml_string(const char *str)
 {
-	ibnd_node_t *node = fabric->nodes;
-	while (node) {
-		lfab.num_nodes++;
-		node = node->next;
+	for (; *str; str++) {
+		switch (*str) {
+			case '<': outbuf_puts(&dot_out, "&lt;"); break;
+			case '>': outbuf_puts(&dot_out, "&gt;"); break;
+			case '&': outbuf_puts(&dot_out, "&amp;"); break;
+			case '"': outbuf_puts(&dot_out, "&quot;"); break;
+			default: outbuf_putc(&dot_out, *str); break;
+		}
 	}
-	lfab.rank_sep = 1 + ((lfab.num_nodes) * 0.5/10);
-	printf("digraph G {\n");
-	printf("   node [shape=record, fontsize=9];\n");
-	printf("   graph [outputorder=nodesfirst, ranksep=\"%d equally\"];\n",
-		lfab.rank_sep);
+}
 
-	ibnd_iter_nodes(fabric, process_node, NULL);
+static void write_graphml(void)
+{
+	ibnd_node_t *node;
+	ibnd_port_t *port;
+	int idx, pnum;
+
+	outbuf_puts(&dot_out,
+"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+"<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+"  <key id=\"guid\" for=\"node\" attr.name=\"guid\" attr.type=\"string\"/>\n"
+"  <key id=\"type\" for=\"node\" attr.name=\"type\" attr.type=\"string\"/>\n"
+"  <key id=\"name\" for=\"node\" attr.name=\"name\" attr.type=\"string\"/>\n"
+"  <key id=\"ports\" for=\"node\" attr.name=\"ports\" attr.type=\"int\"/>\n"
+"  <key id=\"sport\" for=\"edge\" attr.name=\"source_port\" attr.type=\"int\"/>\n"
+"  <key id=\"tport\" for=\"edge\" attr.name=\"target_port\" attr.type=\"int\"/>\n"
+"  <key id=\"width\" for=\"edge\" attr.name=\"width\" attr.type=\"int\"/>\n"
+"  <key id=\"lane_mbps\" for=\"edge\" attr.name=\"lane_mbps\" attr.type=\"int\"/>\n"
+"  <graph id=\"fabric\" edgedefault=\"undirected\">\n");
+
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		node = lfab.nodes[idx];
+		outbuf_printf(&dot_out, "    <node id=\"n%d\"><data key=\"guid\">"
+			      "0x%016" PRIx64 "</data><data key=\"type\">%s"
+			      "</data><data key=\"ports\">%d</data>"
+			      "<data key=\"name\">", export_id[idx],
+			      node->guid, node_type_str(node), node->numports);
+		put_xml_string(lfab.names[idx]);
+		outbuf_puts(&dot_out, "</data></node>\n");
+	}
 
-	if (lfab.roots) {
-		struct lnode *lnode;
-		printf("{rank=min; ");
-		for (lnode = lfab.roots; lnode; lnode = lnode->next) {
-			printf("x%016lx; \n", lnode->node->guid);
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		node = lfab.nodes[idx];
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if (export_rem(idx, pnum) < 0)
+				continue;
+			port = node->ports[pnum];
+			if (!link_end(port, port->remoteport))
+				continue;
+			outbuf_printf(&dot_out, "    <edge source=\"n%d\" "
+				      "target=\"n%d\"><data key=\"sport\">%d"
+				      "</data><data key=\"tport\">%d</data>"
+				      "<data key=\"width\">%d</data>"
+				      "<data key=\"lane_mbps\">%d</data>"
+				      "</edge>\n", export_id[idx],
+				      export_rem(idx, pnum), pnum,
+				      port->remoteport->portnum,
+				      port_lanes(port), port_lane_mbps(port));
 		}
-		printf("}\n");
 	}
+	outbuf_puts(&dot_out, "  </graph>\n</graphml>\n");
+}
+
+/* see ibcsr.h for the layout */
+#define CSR_ALIGN(off) (((off) + 7) & ~(uint64_t)7)
+
+static void put_pad(uint64_t *off)
+{
+	static const char zeros[8];
+	uint64_t aligned = CSR_ALIGN(*off);
+
+	outbuf_append(&dot_out, zeros, aligned - *off);
+	*off = aligned;
+}
+
+static void write_csr(void)
+{
+	ibcsr_hdr_t hdr;
+	ibcsr_node_t cn;
+	ibcsr_edge_t ce;
+	ibnd_node_t *node;
+	ibnd_port_t *port;
+	uint64_t off, row = 0, name = 0;
+	int idx, pnum;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, IBCSR_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = IBCSR_BYTE_ORDER;
+	hdr.version = IBCSR_VERSION;
+	hdr.num_nodes = num_export;
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		for (pnum = 1; pnum <= lfab.nodes[idx]->numports; pnum++)
+			if (export_rem(idx, pnum) >= 0)
+				hdr.num_edges++;
+		hdr.names_len += strlen(lfab.names[idx]) + 1;
+	}
+	hdr.nodes_off = CSR_ALIGN(sizeof(hdr));
+	hdr.row_off = CSR_ALIGN(hdr.nodes_off + num_export * sizeof(cn));
+	hdr.edges_off = CSR_ALIGN(hdr.row_off
+				  + (num_export + 1) * sizeof(uint64_t));
+	hdr.names_off = CSR_ALIGN(hdr.edges_off + hdr.num_edges * sizeof(ce));
+
+	outbuf_append(&dot_out, (char *)&hdr, sizeof(hdr));
+	off = sizeof(hdr);
+	put_pad(&off);
+
+	memset(&cn, 0, sizeof(cn));
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		node = lfab.nodes[idx];
+		cn.guid = node->guid;
+		cn.name = name;
+		cn.type = node->type;
+		cn.numports = node->numports;
+		outbuf_append(&dot_out, (char *)&cn, sizeof(cn));
+		name += strlen(lfab.names[idx]) + 1;
+	}
+	off += num_export * sizeof(cn);
+	put_pad(&off);
+
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		outbuf_append(&dot_out, (char *)&row, sizeof(row));
+		for (pnum = 1; pnum <= lfab.nodes[idx]->numports; pnum++)
+			if (export_rem(idx, pnum) >= 0)
+				row++;
+	}
+	outbuf_append(&dot_out, (char *)&row, sizeof(row));
+	off += (num_export + 1) * sizeof(row);
+	put_pad(&off);
 
-	if (lfab.leafs) {
-		struct lnode *lnode;
-		printf("{rank=max; ");
-		for (lnode = lfab.leafs; lnode; lnode = lnode->next) {
-			printf("x%016lx; \n", lnode->node->guid);
+	memset(&ce, 0, sizeof(ce));
+	for (idx = 0; idx < lfab.num_nodes; idx++) {
+		if (export_id[idx] < 0)
+			continue;
+		node = lfab.nodes[idx];
+		for (pnum = 1; pnum <= node->numports; pnum++) {
+			if ((int)(ce.target = export_rem(idx, pnum)) < 0)
+				continue;
+			port = node->ports[pnum];
+			ce.port = pnum;
+			ce.target_port = port->remoteport->portnum;
+			ce.width = port_lanes(port);
+			ce.lane_mbps = port_lane_mbps(port);
+			outbuf_append(&dot_out, (char *)&ce, sizeof(ce));
 		}
-		printf("}\n");
 	}
+	off += hdr.num_edges * sizeof(ce);
+	put_pad(&off);
+
+	for (idx = 0; idx < lfab.num_nodes; idx++)
+		if (export_id[idx] >= 0)
+			outbuf_append(&dot_out, lfab.names[idx],
+				      strlen(lfab.names[idx]) + 1);
+}
+
+typedef struct graph_format {
+	const char *name;
+	void (*write)(void);
+} graph_format_t;
+
+static graph_format_t graph_formats[] = {
+	{ "dot", NULL },		/* print_dot_file() */
+	{ "json", write_json },
+	{ "graphml", write_graphml },
+	{ "csr", write_csr },
+	{ NULL, NULL }
+};
+
+static graph_format_t *graph_format = &graph_formats[0];
+
+static int print_export_file(ibnd_fabric_t *fabric)
+{
+	int rc;
+
+	index_fabric(fabric);
+	name_nodes();
+	if (scope_hosts)
+		scope_fabric();
+	number_export();
 
-	printf("}\n");
+	outbuf_init(&dot_out, stdout);
+	graph_format->write();
+	if ((rc = outbuf_flush(&dot_out)) != 0)
+		fprintf(stderr, "ERROR: failed to write %s file: %s\n",
+			graph_format->name, strerror(errno));
+	outbuf_free(&dot_out);
+
+	free(export_id);
+	export_id = NULL;
+	free_index();
+	return (rc);
 }
 
 /** =========================================================================
@@ -360,15 +2203,41 @@ usage(void)
 "  -g <cluster_name> DON'T print GUID's on nodes if labeled <cluster_name>N\n"
 "  -r <regex> regex to identify root switches\n"
 "  -i <regex> regex to identify nodes to ignore\n"
-
-/* not done yet */
-//"  -M <node[,node]> plot routes from node to node in red\n"
+"  --collapse-leaves draw the CAs of each switch as one node labeled with\n"
+"                    their hostlist and count\n"
+"  --layout  position the nodes in tiers (see -r) rather than leave it to\n"
+"            dot; render with \"neato -n2\"\n"
+"  -M <node,node> draw the route from node to node in red; may be given more\n"
+"                 than once.  Nodes are names, host names or GUIDs\n"
+"  --routes <file> -M for each \"<node> <node>\" line of file\n"
+"  --heat <seconds> color each link by its utilization over <seconds>, from\n"
+"                   green (idle) to red (saturated)\n"
+"  --diff <cache> draw only what changed since the ibnetdiscover cache file\n"
+"                 <cache>; -e, -g, -i, -r, -M, --routes, --collapse-leaves,\n"
+"                 --layout and --heat do not apply\n"
+"  --diff-summary <file> with --diff, also list the changes in <file>, one\n"
+"                        tab separated node or link per line\n"
+"  --format <fmt> write the fabric as dot (the default), json (networkx\n"
+"                 node-link), graphml or csr (binary adjacency, see\n"
+"                 ibcsr.h); only -i and --hosts apply to the last\n"
+"                 three\n"
+"  --hosts <hostlist> graph only the CAs of these hosts, the switches they\n"
+"                     are cabled to and the switches joining those\n"
 
 "  --node-name-map <map> specify alternate node name map\n"
+"  --load-cache <file>   graph the fabric in an ibnetdiscover cache file\n"
+"                        rather than scanning the fabric\n"
 "  --Ca, -C <ca>         Ca name to use\n"
 "  --Port, -P <port>     Ca port number to use\n"
 "  --timeout, -t <ms>    timeout in ms\n"
+"  --max-mads <n>        MADs to keep outstanding while scanning and reading\n"
+"                        forwarding tables (-M) or counters (--heat);\n"
+"                        default 16\n"
 "  --verbose, -v         increase verbosity level\n"
+"  --stats               print to stderr the time, growth of the heap in use\n"
+"                        in KB (not a count of allocations) and times\n"
+"                        entered of each phase, and the node, port and\n"
+"                        link counts\n"
 "  -R GNDN.  This option is here for backward compatibility\n"
 "\n"
 , argv0
@@ -392,7 +2261,7 @@ int main(int argc, char **argv)
 	int ibd_timeout = 200;
 
         char  ch = 0;
-        static char const str_opts[] = "hS:G:D:r:ei:g:n:C:P:t:v";
+        static char const str_opts[] = "hS:G:D:r:eM:i:g:n:C:P:t:v";
         static const struct option long_opts [] = {
            {"help", 0, 0, 'h'},
 	   {"node-name-map", 1, 0, 1},
@@ -401,6 +2270,17 @@ int main(int argc, char **argv)
 	   {"Port", 1, 0, 'P'},
 	   {"timeout", 1, 0, 't'},
 	   {"verbose", 1, 0, 'v'},
+	   {"stats", 0, 0, 2},
+	   {"load-cache", 1, 0, 3},
+	   {"collapse-leaves", 0, 0, 4},
+	   {"layout", 0, 0, 5},
+	   {"routes", 1, 0, 6},
+	   {"heat", 1, 0, 7},
+	   {"diff", 1, 0, 8},
+	   {"format", 1, 0, 9},
+	   {"hosts", 1, 0, 10},
+	   {"max-mads", 1, 0, 11},
+	   {"diff-summary", 1, 0, 12},
 	   {0, 0, 0, 0}
         };
 
@@ -424,11 +2304,10 @@ int main(int argc, char **argv)
 			case 'e':
 				combine_edges = 1;
 				break;
-			/* Not implemented yet
 			case 'M':
-				node_node_red = strdup(optarg);
+				if (add_route(optarg))
+					exit(1);
 				break;
-			*/
 			case 'i':
 				ignore_regex = strdup(optarg);
 				break;
@@ -441,6 +2320,60 @@ int main(int argc, char **argv)
 			case 1:
 				node_name_map_file = strdup(optarg);
 				break;
+			case 2:
+				stats_enable();
+				break;
+			case 3:
+				load_cache_file = strdup(optarg);
+				break;
+			case 4:
+				collapse_leaves = 1;
+				break;
+			case 5:
+				layout = 1;
+				break;
+			case 6:
+				if (read_routes(optarg))
+					exit(1);
+				break;
+			case 7:
+				heat_secs = (int)strtol(optarg, NULL, 0);
+				if (heat_secs <= 0) {
+					fprintf(stderr, "ERROR: invalid --heat "
+						"\"%s\"\n", optarg);
+					exit(1);
+				}
+				break;
+			case 8:
+				diff_file = strdup(optarg);
+				break;
+			case 9:
+				for (graph_format = graph_formats;
+				     graph_format->name; graph_format++)
+					if (strcmp(graph_format->name,
+						   optarg) == 0)
+						break;
+				if (!graph_format->name) {
+					fprintf(stderr, "ERROR: unknown format "
+						"\"%s\"\n", optarg);
+					exit(1);
+				}
+				break;
+			case 10:
+				scope_hosts = strdup(optarg);
+				break;
+			case 11:
+				max_mads = (int)strtol(optarg, NULL, 0);
+				if (max_mads <= 0) {
+					fprintf(stderr, "ERROR: invalid "
+						"--max-mads \"%s\"\n", optarg);
+					exit(1);
+				}
+				config.max_smps = max_mads;
+				break;
+			case 12:
+				diff_summary_file = strdup(optarg);
+				break;
 			case 'C':
 				ibd_ca = strdup(optarg);
 				break;
@@ -466,6 +2399,51 @@ int main(int argc, char **argv)
                 }
 	}
 
+	/* a cached fabric needs no port; the whole cache is graphed */
+	if (load_cache_file && num_routes) {
+		fprintf(stderr, "ERROR: -M reads the forwarding tables from the "
+			"fabric; it can not be used with --load-cache\n");
+		exit(1);
+	}
+	if (load_cache_file && heat_secs) {
+		fprintf(stderr, "ERROR: --heat reads the port counters of the "
+			"fabric; it can not be used with --load-cache\n");
+		exit(1);
+	}
+	if (diff_file && scope_hosts) {
+		fprintf(stderr, "ERROR: --diff can not be used with --hosts\n");
+		exit(1);
+	}
+	if (diff_file && graph_format->write) {
+		fprintf(stderr, "ERROR: --diff writes only dot\n");
+		exit(1);
+	}
+	if (diff_file && (combine_edges || cluster_name || ignore_regex
+			  || root_regex || num_routes || collapse_leaves
+			  || layout || heat_secs)) {
+		fprintf(stderr, "ERROR: --diff draws each changed link as is; "
+			"it can not be used with -e, -g, -i, -r, -M, --routes, "
+			"--collapse-leaves, --layout or --heat\n");
+		exit(1);
+	}
+	if (diff_summary_file && !diff_file) {
+		fprintf(stderr, "ERROR: --diff-summary needs --diff\n");
+		exit(1);
+	}
+	if (load_cache_file) {
+		node_name_map = nnmap_open(node_name_map_file);
+		stats_push("discovery");
+		fabric = ibnd_load_fabric(load_cache_file, 0);
+		stats_pop();
+		if (!fabric) {
+			fprintf(stderr, "loading cached fabric \"%s\" failed\n",
+				load_cache_file);
+			rc = -1;
+			goto close_map;
+		}
+		goto graph;
+	}
+
 	ibmad_port = mad_rpc_open_port(ibd_ca, ibd_ca_port, mgmt_classes, 4);
 	if (!ibmad_port) {
 		fprintf(stderr, "Failed to open port; %s:%d\n", ibd_ca, ibd_ca_port);
@@ -477,7 +2455,7 @@ int main(int argc, char **argv)
 		config.timeout_ms = ibd_timeout;
 	}
 
-	node_name_map = open_node_name_map(node_name_map_file);
+	node_name_map = nnmap_open(node_name_map_file);
 
 	/* limit the scan to around the target */
 	if (dr_path) {
@@ -499,6 +2477,7 @@ int main(int argc, char **argv)
 		}
 	}
 
+	stats_push("discovery");
 	if (resolved >= 0) {
 		if (!config.max_hops)
 			config.max_hops = 1;
@@ -506,6 +2485,7 @@ int main(int argc, char **argv)
 	} else {
 		fabric = ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL, &config);
 	}
+	stats_pop();
 
 	if (!fabric) {
 		fprintf(stderr, "ibnd_discover_fabric failed\n");
@@ -513,12 +2493,41 @@ int main(int argc, char **argv)
 		goto close_port;
 	}
 
-	print_dot_file(fabric);
+graph:
+	stats_fabric(fabric);
+
+	if (diff_file) {
+		ibnd_fabric_t *old;
+
+		stats_push("discovery");
+		old = ibnd_load_fabric(diff_file, 0);
+		stats_pop();
+		if (!old) {
+			fprintf(stderr, "loading cached fabric \"%s\" failed\n",
+				diff_file);
+			rc = -1;
+		} else {
+			stats_push("output");
+			if (print_diff_file(fabric, old))
+				rc = -1;
+			stats_pop();
+			ibnd_destroy_fabric(old);
+		}
+	} else {
+		stats_push("output");
+		if (graph_format->write ? print_export_file(fabric)
+					: print_dot_file(fabric))
+			rc = -1;
+		stats_pop();
+	}
 
 	ibnd_destroy_fabric(fabric);
+	stats_report(stderr);
 
 close_port:
-	mad_rpc_close_port(ibmad_port);
-	close_node_name_map(node_name_map);
+	if (ibmad_port)
+		mad_rpc_close_port(ibmad_port);
+close_map:
+	nnmap_close(node_name_map);
 	exit(rc);
 }
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+
+#include "mad_window.h"
+
+void
+mad_req_pma(mad_req_t *req, int lid, int port, unsigned id, void *ctx)
+{
+	memset(req, 0, sizeof(*req));
+	ib_portid_set(&req->portid, lid, 1, IB_DEFAULT_QP1_QKEY);
+	req->rpc.mgtclass = IB_PERFORMANCE_CLASS;
+	req->rpc.method = IB_MAD_METHOD_GET;
+	req->rpc.attr.id = id;
+	req->rpc.dataoffs = IB_PC_DATA_OFFS;
+	req->rpc.datasz = IB_PC_DATA_SZ;
+	mad_set_field(req->data, 0, IB_PC_PORT_SELECT_F, port);
+	req->ctx = ctx;
+}
+
+void
+mad_req_smp(mad_req_t *req, int lid, unsigned id, unsigned mod, void *ctx)
+{
+	memset(req, 0, sizeof(*req));
+	ib_portid_set(&req->portid, lid, 0, 0);
+	req->rpc.mgtclass = IB_SMI_CLASS;
+	req->rpc.method = IB_MAD_METHOD_GET;
+	req->rpc.attr.id = id;
+	req->rpc.attr.mod = mod;
+	req->rpc.dataoffs = IB_SMP_DATA_OFFS;
+	req->rpc.datasz = IB_SMP_DATA_SIZE;
+	req->ctx = ctx;
+}
+
+/* Each run takes a fresh block of TIDs so a late reply to an abandoned run
+ * can not be taken for the answer to a later one.
+ */
+static uint32_t next_tid;
+static int next_tid_set;
+
+static void
+mad_complete(mad_req_t *req, int ok, mad_done_f done, void *arg)
+{
+	req->ok = ok;
+	if (done)
+		done(req, arg);
+}
+
+int
+mad_window_run(struct ibmad_port *srcport, mad_req_t *reqs, int num,
+	       int max_mads, mad_done_f done, void *arg)
+{
+	int fd = mad_rpc_portid(srcport);
+	int timeout = mad_get_timeout(srcport, 0);
+	int retries = mad_get_retries(srcport);
+	uint32_t base;
+	int next = 0, outstanding = 0, failed = 0, agent, len, i;
+	uint8_t *pending;	/* 1 while request i is in flight */
+	mad_req_t *req;
+	void *umad;
+	uint8_t *mad;
+	uint32_t tid;
+
+	if (num <= 0)
+		return (0);
+	if (max_mads < 1)
+		max_mads = 1;
+	if (!next_tid_set) {
+		next_tid = (uint32_t)mad_trid();
+		next_tid_set = 1;
+	}
+	base = next_tid;
+	next_tid += (uint32_t)num;
+
+	umad = malloc(umad_size() + IB_MAD_SIZE);
+	pending = calloc(num, sizeof(*pending));
+	if (!umad || !pending) {
+		fprintf(stderr, "ERROR: failed to allocate MAD buffer\n");
+		exit(1);
+	}
+	while (next < num || outstanding) {
+		/* fill the window */
+		while (next < num && outstanding < max_mads) {
+			req = &reqs[next];
+			/* the kernel owns the upper 32 bits of the TID */
+			req->rpc.trid = base + (uint32_t)next;
+			agent = mad_rpc_class_agent(srcport, req->rpc.mgtclass);
+			memset(umad, 0, umad_size() + IB_MAD_SIZE);
+			if (agent < 0
+			    || mad_build_pkt(umad, &req->rpc, &req->portid,
+					     NULL, req->data) < 0
+			    || umad_send(fd, agent, umad, IB_MAD_SIZE, timeout,
+					 retries) < 0) {
+				failed++;
+				mad_complete(req, 0, done, arg);
+			} else {
+				pending[next] = 1;
+				outstanding++;
+			}
+			next++;
+		}
+		if (!outstanding)
+			break;
+
+		/* the kernel answers every send within its timeout and
+		 * retries, with a timed out status if need be; waiting
+		 * longer than that means the replies are lost */
+		len = IB_MAD_SIZE;
+		if (umad_recv(fd, umad, &len, timeout * (retries + 1) * 2)
+		    < 0) {
+			for (i = 0; i < next; i++)
+				if (pending[i]) {
+					pending[i] = 0;
+					failed++;
+					mad_complete(&reqs[i], 0, done, arg);
+				}
+			outstanding = 0;
+			continue;
+		}
+
+		/* match the reply by the low half of its TID; a stray or
+		 * duplicate reply is dropped */
+		mad = umad_get_mad(umad);
+		tid = (uint32_t)mad_get_field64(mad, 0, IB_MAD_TRID_F) - base;
+		if (tid >= (uint32_t)next || !pending[tid])
+			continue;
+		pending[tid] = 0;
+		outstanding--;
+
+		req = &reqs[tid];
+		if (umad_status(umad)
+		    || mad_get_field(mad, 0, IB_MAD_STATUS_F)) {
+			failed++;
+			mad_complete(req, 0, done, arg);
+			continue;
+		}
+		memcpy(req->data, mad + req->rpc.dataoffs, req->rpc.datasz);
+		mad_complete(req, 1, done, arg);
+	}
+
+	free(pending);
+	free(umad);
+	return (failed);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _MAD_WINDOW_H
+#define _MAD_WINDOW_H
+
+#include <stdint.h>
+#include <infiniband/mad.h>
+
+/* Many MADs kept in flight on one ibmad_port.
+ *
+ * The requests are sent with umad_send() up to "max_mads" at a time and
+ * each reply is matched to its request by transaction ID as it arrives, so
+ * a sweep of N queries costs about N / max_mads round trips rather than N.
+ * The kernel retries and times out each MAD with the port's timeout and
+ * retries, as smp_query_via() and pma_query_via() do.
+ */
+typedef struct mad_req {
+	ib_portid_t portid;
+	ib_rpc_t rpc;
+	uint8_t data[IB_PC_DATA_SZ];	/* sent; the reply's once answered */
+	int ok;				/* 1 answered, 0 failed */
+	void *ctx;			/* the caller's */
+} mad_req_t;
+
+/*
+ * mad_req_pma():
+ *
+ * A PerfMgt Get of attribute "id" for port "port" of the node at "lid".
+ */
+void mad_req_pma(mad_req_t *req, int lid, int port, unsigned id, void *ctx);
+
+/*
+ * mad_req_smp():
+ *
+ * A LID routed SubnMgt Get of attribute "id", modifier "mod", from "lid".
+ */
+void mad_req_smp(mad_req_t *req, int lid, unsigned id, unsigned mod,
+		 void *ctx);
+
+/* called once for every request, answered or not, as it completes */
+typedef void (*mad_done_f)(mad_req_t *req, void *arg);
+
+/*
+ * mad_window_run():
+ *
+ * Send the "num" requests through "srcport" keeping at most "max_mads"
+ * outstanding and call "done" for each as it completes.  Returns the
+ * number of requests that failed.
+ */
+int mad_window_run(struct ibmad_port *srcport, mad_req_t *reqs, int num,
+		   int max_mads, mad_done_f done, void *arg);
+
+#endif /* _MAD_WINDOW_H */
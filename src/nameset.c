@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "nameset.h"
+#include "arena.h"
+
+#define NAMESET_MIN_BITS 4
+
+typedef struct nameset_ent {
+	const char *name;
+	uint32_t hash;
+	int marked;
+} nameset_ent_t;
+
+struct nameset {
+	arena_t *names;
+	nameset_ent_t *ents;	/* in the order added */
+	unsigned num_ents;
+	unsigned max_ents;
+	int *table;		/* index into ents; -1 == empty */
+	unsigned mask;
+};
+
+/* FNV-1a */
+static uint32_t
+name_hash(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+static int
+alloc_table(nameset_t *set, unsigned size)
+{
+	unsigned i;
+
+	if ((set->table = malloc(size * sizeof(*set->table))) == NULL)
+		return (-1);
+	for (i = 0; i < size; i++)
+		set->table[i] = -1;
+	set->mask = size - 1;
+	return (0);
+}
+
+static int
+find_slot(nameset_t *set, const char *name, uint32_t hash)
+{
+	unsigned s;
+
+	for (s = hash & set->mask; set->table[s] >= 0;
+	     s = (s + 1) & set->mask) {
+		nameset_ent_t *ent = &set->ents[set->table[s]];
+		if (ent->hash == hash && strcmp(ent->name, name) == 0)
+			break;
+	}
+	return (s);
+}
+
+static int
+nameset_grow(nameset_t *set)
+{
+	int *old = set->table;
+	unsigned size = (set->mask + 1) * 2;
+	nameset_ent_t *ents;
+	unsigned i;
+
+	if ((ents = realloc(set->ents, (size / 2) * sizeof(*ents))) == NULL)
+		return (-1);
+	set->ents = ents;
+	set->max_ents = size / 2;
+
+	if (alloc_table(set, size)) {
+		set->table = old;
+		return (-1);
+	}
+	free(old);
+
+	for (i = 0; i < set->num_ents; i++)
+		set->table[find_slot(set, set->ents[i].name,
+				     set->ents[i].hash)] = i;
+	return (0);
+}
+
+nameset_t *
+nameset_create(unsigned expected)
+{
+	nameset_t *set = calloc(1, sizeof(*set));
+	unsigned size = 1 << NAMESET_MIN_BITS;
+
+	if (!set)
+		return (NULL);
+
+	/* keep the table at most half full */
+	while (size < 2 * expected)
+		size <<= 1;
+
+	set->names = arena_create(0);
+	set->max_ents = size / 2;
+	set->ents = malloc(set->max_ents * sizeof(*set->ents));
+	if (!set->names || !set->ents || alloc_table(set, size)) {
+		nameset_destroy(set);
+		return (NULL);
+	}
+	return (set);
+}
+
+void
+nameset_destroy(nameset_t *set)
+{
+	if (!set)
+		return;
+	arena_destroy(set->names);
+	free(set->ents);
+	free(set->table);
+	free(set);
+}
+
+int
+nameset_add(nameset_t *set, const char *name)
+{
+	uint32_t hash = name_hash(name);
+	nameset_ent_t *ent;
+	int s;
+
+	if (set->table[find_slot(set, name, hash)] >= 0)
+		return (0);
+
+	if (set->num_ents >= set->max_ents && nameset_grow(set))
+		return (-1);
+
+	ent = &set->ents[set->num_ents];
+	if ((ent->name = arena_strdup(set->names, name)) == NULL)
+		return (-1);
+	ent->hash = hash;
+	ent->marked = 0;
+
+	s = find_slot(set, name, hash);
+	set->table[s] = set->num_ents++;
+	return (0);
+}
+
+int
+nameset_mark(nameset_t *set, const char *name)
+{
+	int idx = set->table[find_slot(set, name, name_hash(name))];
+
+	if (idx < 0)
+		return (0);
+	set->ents[idx].marked = 1;
+	return (1);
+}
+
+void
+nameset_clear_marks(nameset_t *set)
+{
+	unsigned i;
+
+	for (i = 0; i < set->num_ents; i++)
+		set->ents[i].marked = 0;
+}
+
+unsigned
+nameset_count(nameset_t *set)
+{
+	return (set->num_ents);
+}
+
+void
+nameset_iter_unmarked(nameset_t *set, nameset_iter_f fn, void *arg)
+{
+	unsigned i;
+
+	for (i = 0; i < set->num_ents; i++)
+		if (!set->ents[i].marked)
+			fn(set->ents[i].name, arg);
+}
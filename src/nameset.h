@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _NAMESET_H
+#define _NAMESET_H
+
+/* A set of host names with a "found" mark on each.
+ *
+ * Names are hashed into an open addressing table so adding, marking and
+ * testing a name is O(1) no matter how large the set is.  Iteration is in
+ * the order names were added.
+ */
+typedef struct nameset nameset_t;
+
+typedef void (*nameset_iter_f)(const char *name, void *arg);
+
+/* expected sizes the table; it grows if that is exceeded */
+nameset_t *nameset_create(unsigned expected);
+void nameset_destroy(nameset_t *set);
+
+/* add a copy of name; returns 0 on success (or if already present), -1 on
+ * allocation failure */
+int nameset_add(nameset_t *set, const char *name);
+
+/* mark name as found; returns 1 if name is in the set, 0 otherwise */
+int nameset_mark(nameset_t *set, const char *name);
+
+/* clear the mark on every name */
+void nameset_clear_marks(nameset_t *set);
+
+/* number of names in the set */
+unsigned nameset_count(nameset_t *set);
+
+/* call fn for every name which has not been marked */
+void nameset_iter_unmarked(nameset_t *set, nameset_iter_f fn, void *arg);
+
+#endif /* _NAMESET_H */
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <complib/cl_nodenamemap.h>
+
+#include "nnmap.h"
+#include "guid_index.h"
+#include "arena.h"
+
+#define NNMAP_MAGIC 0x4e4e4d50	/* "NNMP" */
+#define NNMAP_MAGIC_SWAPPED 0x504d4e4e
+#define NNMAP_VERSION 1
+#define NNMAP_MIN_SIZE 16
+#define NODEDESC_SIZE 64	/* NodeDescription; clean_nodedesc() writes all of it */
+
+/* A compiled map is a header, the table of slots and then the names, all
+ * in native byte order.  Slots point at their name by offset; offset 0 (an
+ * empty string) marks an empty slot.  The table is at most half full.
+ */
+typedef struct nnmap_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t size;		/* slots; a power of 2 */
+	uint64_t names_len;
+} nnmap_hdr_t;
+
+typedef struct nnmap_slot {
+	uint64_t guid;
+	uint32_t name;
+	uint32_t pad;
+} nnmap_slot_t;
+
+struct nnmap {
+	/* the table; mmap'd from a compiled map or built from a text one */
+	void *base;
+	size_t len;
+	int mapped;
+	nnmap_hdr_t *hdr;
+	nnmap_slot_t *slots;
+	const char *names;
+	unsigned shift;
+
+	/* the default map of open_node_name_map(); remap_node_name() returns
+	 * a copy on every call so the names are cached per GUID */
+	nn_map_t *cl_map;
+	guid_index_t *cache;
+	const char **cache_names;
+	int cache_num;
+	int cache_size;
+	arena_t *arena;
+};
+
+/* entries of a text map while it is being compiled */
+typedef struct nnmap_ent {
+	uint64_t guid;
+	const char *name;
+	unsigned seq;
+} nnmap_ent_t;
+
+typedef struct nnmap_build {
+	nnmap_ent_t *ents;
+	unsigned num;
+	unsigned size;
+	arena_t *arena;
+} nnmap_build_t;
+
+static unsigned
+slot_of(nnmap_t *map, uint64_t guid)
+{
+	return ((unsigned)((guid * 0x9E3779B97F4A7C15ULL) >> map->shift));
+}
+
+static void
+set_table(nnmap_t *map, void *base, size_t len)
+{
+	unsigned size;
+
+	map->base = base;
+	map->len = len;
+	map->hdr = base;
+	map->slots = (nnmap_slot_t *)(map->hdr + 1);
+	map->names = (const char *)(map->slots + map->hdr->size);
+	for (map->shift = 64, size = map->hdr->size; size > 1; size >>= 1)
+		map->shift--;
+}
+
+/** =========================================================================
+ * Compiling
+ */
+static int
+add_ent(void *arg, uint64_t guid, char *name)
+{
+	nnmap_build_t *b = arg;
+
+	if (b->num == b->size) {
+		unsigned size = b->size ? b->size * 2 : 1024;
+		nnmap_ent_t *ents = realloc(b->ents, size * sizeof(*ents));
+		if (!ents)
+			return (-1);
+		b->ents = ents;
+		b->size = size;
+	}
+	b->ents[b->num].guid = guid;
+	b->ents[b->num].seq = b->num;
+	if ((b->ents[b->num].name = arena_strdup(b->arena, name)) == NULL)
+		return (-1);
+	b->num++;
+	return (0);
+}
+
+static int
+ent_cmp(const void *a, const void *b)
+{
+	const nnmap_ent_t *ea = a;
+	const nnmap_ent_t *eb = b;
+
+	if (ea->guid != eb->guid)
+		return (ea->guid < eb->guid ? -1 : 1);
+	return (ea->seq < eb->seq ? -1 : (ea->seq > eb->seq));
+}
+
+/* parse text_file in to a table in memory; NULL on failure */
+static void *
+build_table(char *text_file, size_t *len)
+{
+	nnmap_build_t b;
+	nnmap_hdr_t *hdr;
+	nnmap_t map;
+	char *names;
+	void *base = NULL;
+	uint64_t off;
+	unsigned i, j, count = 0, size = NNMAP_MIN_SIZE;
+	size_t names_len = 1;
+
+	memset(&b, 0, sizeof(b));
+	if ((b.arena = arena_create(0)) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate node name map\n");
+		return (NULL);
+	}
+
+	if (parse_node_map(text_file, add_ent, &b)) {
+		fprintf(stderr, "WARNING failed to open node name map \"%s\" "
+			"(%s)\n", text_file, strerror(errno));
+		goto out;
+	}
+
+	/* sorted so the compiled file does not depend on the order of the
+	 * text; the first entry for a GUID wins as with open_node_name_map */
+	qsort(b.ents, b.num, sizeof(*b.ents), ent_cmp);
+	for (i = 0; i < b.num; i++) {
+		if (i && b.ents[i].guid == b.ents[i - 1].guid)
+			continue;
+		count++;
+		names_len += strlen(b.ents[i].name) + 1;
+	}
+	while (size < 2 * count)
+		size <<= 1;
+
+	*len = sizeof(*hdr) + size * sizeof(nnmap_slot_t) + names_len;
+	if ((base = calloc(1, *len)) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate node name map\n");
+		goto out;
+	}
+	hdr = base;
+	hdr->magic = NNMAP_MAGIC;
+	hdr->version = NNMAP_VERSION;
+	hdr->count = count;
+	hdr->size = size;
+	hdr->names_len = names_len;
+	set_table(&map, base, *len);
+	names = (char *)map.names;
+
+	for (i = 0, off = 1; i < b.num; i++) {
+		if (i && b.ents[i].guid == b.ents[i - 1].guid)
+			continue;
+		j = slot_of(&map, b.ents[i].guid);
+		while (map.slots[j].name)
+			j = (j + 1) & (size - 1);
+		map.slots[j].guid = b.ents[i].guid;
+		map.slots[j].name = off;
+		strcpy(names + off, b.ents[i].name);
+		off += strlen(b.ents[i].name) + 1;
+	}
+
+out:
+	free(b.ents);
+	arena_destroy(b.arena);
+	return (base);
+}
+
+int
+nnmap_compile(char *text_file, const char *out_file)
+{
+	char *tmp = NULL;
+	void *base;
+	size_t len;
+	FILE *fp;
+	int rc = -1;
+
+	if ((base = build_table(text_file, &len)) == NULL)
+		return (-1);
+
+	/* replace out_file atomically; tools may have the old one mapped */
+	if ((tmp = malloc(strlen(out_file) + 32)) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate file name\n");
+		goto out;
+	}
+	sprintf(tmp, "%s.tmp.%d", out_file, (int)getpid());
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		fprintf(stderr, "ERROR: failed to open \"%s\": %s\n",
+			tmp, strerror(errno));
+		goto out;
+	}
+	if (fwrite(base, 1, len, fp) != len || fflush(fp)
+	    || fsync(fileno(fp))) {
+		fprintf(stderr, "ERROR: failed to write \"%s\": %s\n",
+			tmp, strerror(errno));
+		fclose(fp);
+		unlink(tmp);
+		goto out;
+	}
+	if (fclose(fp) || rename(tmp, out_file)) {
+		fprintf(stderr, "ERROR: failed to replace \"%s\": %s\n",
+			out_file, strerror(errno));
+		unlink(tmp);
+		goto out;
+	}
+	rc = 0;
+
+out:
+	free(tmp);
+	free(base);
+	return (rc);
+}
+
+/** =========================================================================
+ * Loading
+ */
+
+/* check a compiled map before trusting any offset in it */
+static int
+valid_table(void *base, size_t len)
+{
+	nnmap_hdr_t *hdr = base;
+	nnmap_slot_t *slots;
+	const char *names;
+	unsigned i, used = 0;
+
+	if (len < sizeof(*hdr) || hdr->version != NNMAP_VERSION
+	    || hdr->size < NNMAP_MIN_SIZE || (hdr->size & (hdr->size - 1))
+	    || hdr->count > hdr->size / 2 || hdr->names_len < 1
+	    || (len - sizeof(*hdr)) / sizeof(*slots) < hdr->size
+	    || len != sizeof(*hdr) + hdr->size * sizeof(*slots)
+		      + hdr->names_len)
+		return (0);
+
+	slots = (nnmap_slot_t *)(hdr + 1);
+	names = (const char *)(slots + hdr->size);
+	if (names[0] != '\0' || names[hdr->names_len - 1] != '\0')
+		return (0);
+	for (i = 0; i < hdr->size; i++) {
+		if (slots[i].name >= hdr->names_len)
+			return (0);
+		if (slots[i].name)
+			used++;
+	}
+
+	/* nnmap_lookup() probes until it finds an empty slot; the count
+	 * check above keeps half the table empty only if it is the truth */
+	return (used == hdr->count);
+}
+
+static int
+map_compiled(nnmap_t *map, char *file, int fd, size_t len)
+{
+	void *base;
+
+	base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "WARNING failed to map node name map \"%s\" "
+			"(%s)\n", file, strerror(errno));
+		return (-1);
+	}
+	if (!valid_table(base, len)) {
+		fprintf(stderr, "WARNING node name map \"%s\" is corrupt\n",
+			file);
+		munmap(base, len);
+		return (-1);
+	}
+	set_table(map, base, len);
+	map->mapped = 1;
+	return (0);
+}
+
+nnmap_t *
+nnmap_open(char *file)
+{
+	nnmap_t *map;
+	struct stat st;
+	uint32_t magic = 0;
+	void *base;
+	size_t len;
+	int fd;
+
+	if ((map = calloc(1, sizeof(*map))) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate node name map\n");
+		return (NULL);
+	}
+
+	if (!file) {
+		if ((map->cl_map = open_node_name_map(NULL)) == NULL)
+			goto fail;
+		map->cache = guid_index_create(1024);
+		map->arena = arena_create(0);
+		if (!map->cache || !map->arena) {
+			fprintf(stderr, "ERROR: failed to allocate node name "
+				"map\n");
+			goto fail;
+		}
+		return (map);
+	}
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		fprintf(stderr, "WARNING failed to open node name map \"%s\" "
+			"(%s)\n", file, strerror(errno));
+		goto fail;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size >= sizeof(magic)
+	    && read(fd, &magic, sizeof(magic)) != sizeof(magic))
+		magic = 0;
+
+	if (magic == NNMAP_MAGIC) {
+		int rc = map_compiled(map, file, fd, st.st_size);
+		close(fd);
+		if (rc)
+			goto fail;
+		return (map);
+	}
+	close(fd);
+
+	if (magic == NNMAP_MAGIC_SWAPPED) {
+		fprintf(stderr, "WARNING node name map \"%s\" was compiled on "
+			"a host of different byte order\n", file);
+		goto fail;
+	}
+
+	/* text */
+	if ((base = build_table(file, &len)) == NULL)
+		goto fail;
+	set_table(map, base, len);
+	return (map);
+
+fail:
+	nnmap_close(map);
+	return (NULL);
+}
+
+void
+nnmap_close(nnmap_t *map)
+{
+	if (!map)
+		return;
+	if (map->mapped)
+		munmap(map->base, map->len);
+	else
+		free(map->base);
+	if (map->cl_map)
+		close_node_name_map(map->cl_map);
+	if (map->cache)
+		guid_index_destroy(map->cache);
+	if (map->arena)
+		arena_destroy(map->arena);
+	free(map->cache_names);
+	free(map);
+}
+
+/** =========================================================================
+ * Lookups
+ */
+static const char *
+cl_lookup(nnmap_t *map, uint64_t guid)
+{
+	char nodedesc[NODEDESC_SIZE] = "";
+	const char *name = NULL;
+	char *rc;
+	int idx;
+
+	if ((idx = guid_index_lookup(map->cache, guid)) >= 0)
+		return (map->cache_names[idx]);
+
+	/* an empty nodedesc comes back if guid is not mapped */
+	rc = remap_node_name(map->cl_map, guid, nodedesc);
+	if (rc && rc[0] != '\0')
+		name = arena_strdup(map->arena, rc);
+	free(rc);
+
+	if (map->cache_num == map->cache_size) {
+		int size = map->cache_size ? map->cache_size * 2 : 1024;
+		const char **names = realloc(map->cache_names,
+					     size * sizeof(*names));
+		if (!names)
+			return (name);
+		map->cache_names = names;
+		map->cache_size = size;
+	}
+	if (guid_index_insert(map->cache, guid, map->cache_num) == 0)
+		map->cache_names[map->cache_num++] = name;
+	return (name);
+}
+
+const char *
+nnmap_lookup(nnmap_t *map, uint64_t guid)
+{
+	unsigned i;
+
+	if (!map)
+		return (NULL);
+	if (map->cl_map)
+		return (cl_lookup(map, guid));
+
+	for (i = slot_of(map, guid); map->slots[i].name;
+	     i = (i + 1) & (map->hdr->size - 1))
+		if (map->slots[i].guid == guid)
+			return (map->names + map->slots[i].name);
+	return (NULL);
+}
+
+const char *
+nnmap_name(nnmap_t *map, uint64_t guid, char *nodedesc)
+{
+	const char *name = nnmap_lookup(map, guid);
+
+	return (name ? name : clean_nodedesc(nodedesc));
+}
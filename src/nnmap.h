@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _NNMAP_H
+#define _NNMAP_H
+
+#include <stdint.h>
+
+/* GUID to name lookups for the node name map.
+ *
+ * A map compiled by ibcompilenodemap is a hash table laid out for use in
+ * place; it is mmap'd and looked up without parsing or copying anything.
+ * A text map is parsed in to the same layout in memory.  Names returned
+ * are borrowed from the map (or the node) and must not be freed.
+ */
+typedef struct nnmap nnmap_t;
+
+/*
+ * nnmap_open():
+ *
+ * Open a compiled or text node name map.  NULL selects the default map of
+ * open_node_name_map().  Returns NULL if there is no map to use; NULL is
+ * a valid (empty) map for the calls below.
+ */
+nnmap_t *nnmap_open(char *file);
+void nnmap_close(nnmap_t *map);
+
+/*
+ * nnmap_lookup():
+ *
+ * Returns the name mapped to "guid" or NULL if it is not in the map.
+ */
+const char *nnmap_lookup(nnmap_t *map, uint64_t guid);
+
+/*
+ * nnmap_name():
+ *
+ * As remap_node_name(): the mapped name of "guid" or "nodedesc" (cleaned
+ * in place of unprintable characters) if it is not mapped.
+ */
+const char *nnmap_name(nnmap_t *map, uint64_t guid, char *nodedesc);
+
+/*
+ * nnmap_compile():
+ *
+ * Compile the text map "text_file" in to "out_file".  Returns 0 on
+ * success, -1 on failure (with a message on stderr).
+ */
+int nnmap_compile(char *text_file, const char *out_file);
+
+#endif /* _NNMAP_H */
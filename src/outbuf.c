@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "outbuf.h"
+
+#define OUTBUF_MIN_SIZE 4096
+
+void
+outbuf_init(outbuf_t *ob, FILE *fp)
+{
+	memset(ob, 0, sizeof(*ob));
+	ob->fp = fp;
+}
+
+static int
+outbuf_reserve(outbuf_t *ob, size_t len)
+{
+	size_t size = ob->size ? ob->size : OUTBUF_MIN_SIZE;
+	char *buf;
+
+	if (ob->len + len + 1 <= ob->size)
+		return (0);
+
+	while (size < ob->len + len + 1)
+		size *= 2;
+	if ((buf = realloc(ob->buf, size)) == NULL) {
+		ob->error = 1;
+		return (-1);
+	}
+	ob->buf = buf;
+	ob->size = size;
+	return (0);
+}
+
+static int
+outbuf_write(outbuf_t *ob)
+{
+	if (!ob->fp || !ob->len)
+		return (0);
+	if (fwrite(ob->buf, 1, ob->len, ob->fp) != ob->len)
+		ob->error = 1;
+	ob->len = 0;
+	ob->buf[0] = '\0';
+	return (ob->error ? -1 : 0);
+}
+
+static inline int
+outbuf_check_flush(outbuf_t *ob)
+{
+	if (ob->fp && ob->len >= OUTBUF_FLUSH_SIZE)
+		return (outbuf_write(ob));
+	return (0);
+}
+
+int
+outbuf_append(outbuf_t *ob, const char *str, size_t len)
+{
+	if (outbuf_reserve(ob, len))
+		return (-1);
+	memcpy(&ob->buf[ob->len], str, len);
+	ob->len += len;
+	ob->buf[ob->len] = '\0';
+	return (outbuf_check_flush(ob));
+}
+
+int
+outbuf_puts(outbuf_t *ob, const char *str)
+{
+	return (outbuf_append(ob, str, strlen(str)));
+}
+
+int
+outbuf_putc(outbuf_t *ob, char c)
+{
+	return (outbuf_append(ob, &c, 1));
+}
+
+int
+outbuf_write_cb(void *ob, const char *str, size_t len)
+{
+	return (outbuf_append((outbuf_t *)ob, str, len));
+}
+
+int
+outbuf_vprintf(outbuf_t *ob, const char *fmt, va_list ap)
+{
+	va_list ap2;
+	int n;
+
+	if (outbuf_reserve(ob, 128))
+		return (-1);
+
+	va_copy(ap2, ap);
+	n = vsnprintf(&ob->buf[ob->len], ob->size - ob->len, fmt, ap2);
+	va_end(ap2);
+	if (n < 0) {
+		ob->error = 1;
+		return (-1);
+	}
+
+	if ((size_t)n >= ob->size - ob->len) {
+		if (outbuf_reserve(ob, n))
+			return (-1);
+		vsnprintf(&ob->buf[ob->len], ob->size - ob->len, fmt, ap);
+	}
+	ob->len += n;
+	return (outbuf_check_flush(ob));
+}
+
+int
+outbuf_printf(outbuf_t *ob, const char *fmt, ...)
+{
+	va_list ap;
+	int rc;
+
+	va_start(ap, fmt);
+	rc = outbuf_vprintf(ob, fmt, ap);
+	va_end(ap);
+	return (rc);
+}
+
+int
+outbuf_flush(outbuf_t *ob)
+{
+	outbuf_write(ob);
+	if (ob->fp && fflush(ob->fp))
+		ob->error = 1;
+	return (ob->error ? -1 : 0);
+}
+
+void
+outbuf_free(outbuf_t *ob)
+{
+	free(ob->buf);
+	ob->buf = NULL;
+	ob->len = ob->size = 0;
+}
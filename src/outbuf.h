@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _OUTBUF_H
+#define _OUTBUF_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <sys/types.h>
+
+/* A growable output buffer with a tracked length.
+ *
+ * If the buffer is bound to a FILE it is written out whenever it grows past
+ * OUTBUF_FLUSH_SIZE and by outbuf_flush(); otherwise it simply accumulates
+ * until the caller is done with it.
+ */
+#define OUTBUF_FLUSH_SIZE (256 * 1024)
+
+typedef struct outbuf {
+	char *buf;
+	size_t len;
+	size_t size;
+	FILE *fp;
+	int error;
+} outbuf_t;
+
+/* bind to fp (may be NULL) with an empty buffer */
+void outbuf_init(outbuf_t *ob, FILE *fp);
+
+/* append len bytes of str */
+int outbuf_append(outbuf_t *ob, const char *str, size_t len);
+
+/* append a NUL terminated string */
+int outbuf_puts(outbuf_t *ob, const char *str);
+
+/* append a single character */
+int outbuf_putc(outbuf_t *ob, char c);
+
+/* append printf style formatted output */
+int outbuf_printf(outbuf_t *ob, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+int outbuf_vprintf(outbuf_t *ob, const char *fmt, va_list ap);
+
+/* outbuf_append() for use as a write callback; ob is the outbuf_t */
+int outbuf_write_cb(void *ob, const char *str, size_t len);
+
+/* write anything buffered to the bound FILE and fflush it.
+ * Returns -1 if any write since outbuf_init() has failed.
+ */
+int outbuf_flush(outbuf_t *ob);
+
+/* release the buffer; does not flush or close the FILE */
+void outbuf_free(outbuf_t *ob);
+
+#endif /* _OUTBUF_H */
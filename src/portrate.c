@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <infiniband/mad.h>
+#include <iba/ib_types.h>
+
+#include "portrate.h"
+
+typedef struct port_speed {
+	const char *name;
+	int lane_kbps;		/* signalling rate */
+	int enc_data;		/* line encoding: enc_data bits of data in */
+	int enc_line;		/* every enc_line bits */
+} port_speed_t;
+
+/* by LinkSpeedActive */
+static const port_speed_t speeds[] = {
+	{ "SDR", 2500000, 8, 10 },
+	{ "DDR", 5000000, 8, 10 },
+	{ "QDR", 10000000, 8, 10 },
+};
+
+#if HAVE_DECL_IB_PORT_LINK_SPEED_EXT_ACTIVE_F
+/* by LinkSpeedExtActive */
+static const port_speed_t ext_speeds[] = {
+	{ "FDR", 14062500, 64, 66 },
+	{ "EDR", 25781250, 64, 66 },
+	{ "HDR", 53125000, 64, 66 },
+	{ "NDR", 106250000, 64, 66 },
+};
+
+/* LinkSpeedExtActive is reserved unless IsExtendedSpeedsSupported is set in
+ * the CapabilityMask, which a switch reports on port 0 only (as iblinkinfo
+ * reads it).
+ */
+static int port_has_ext_speeds(ibnd_port_t *port)
+{
+	uint8_t *info = port->info;
+	uint32_t cap_mask;
+
+	if (port->node->type == IB_NODE_SWITCH) {
+		if (!port->node->ports[0])
+			return (0);
+		info = port->node->ports[0]->info;
+	}
+	cap_mask = mad_get_field(info, 0, IB_PORT_CAPMASK_F);
+	return ((cap_mask & cl_ntoh32(IB_PORT_CAP_HAS_EXT_SPEEDS)) != 0);
+}
+#endif
+
+/* the speed fields are bitmasks of which only one bit is set when active */
+static const port_speed_t *port_speed(ibnd_port_t *port)
+{
+#if HAVE_DECL_IB_PORT_LINK_SPEED_EXT_ACTIVE_F
+	if (port_has_ext_speeds(port))
+		switch (mad_get_field(port->info, 0,
+				      IB_PORT_LINK_SPEED_EXT_ACTIVE_F)) {
+			case 1: return (&ext_speeds[0]);
+			case 2: return (&ext_speeds[1]);
+			case 4: return (&ext_speeds[2]);
+			case 8: return (&ext_speeds[3]);
+		}
+#endif
+	switch (mad_get_field(port->info, 0, IB_PORT_LINK_SPEED_ACTIVE_F)) {
+		case 1: return (&speeds[0]);
+		case 2: return (&speeds[1]);
+		case 4: return (&speeds[2]);
+	}
+	return (NULL);
+}
+
+int port_lanes(ibnd_port_t *port)
+{
+	switch (mad_get_field(port->info, 0, IB_PORT_LINK_WIDTH_ACTIVE_F)) {
+		case 1: return (1);
+		case 2: return (4);
+		case 4: return (8);
+		case 8: return (12);
+		case 16: return (2);
+	}
+	return (0);
+}
+
+int port_lane_mbps(ibnd_port_t *port)
+{
+	const port_speed_t *speed = port_speed(port);
+
+	return (speed ? speed->lane_kbps / 1000 : 0);
+}
+
+int port_data_mbps(ibnd_port_t *port)
+{
+	const port_speed_t *speed = port_speed(port);
+
+	if (!speed)
+		return (0);
+	return ((long long)port_lanes(port) * speed->lane_kbps
+		* speed->enc_data / speed->enc_line / 1000);
+}
+
+const char *port_width_str(ibnd_port_t *port)
+{
+	switch (port_lanes(port)) {
+		case 1: return ("1x");
+		case 2: return ("2x");
+		case 4: return ("4x");
+		case 8: return ("8x");
+		case 12: return ("12x");
+	}
+	return ("?x");
+}
+
+const char *port_speed_str(ibnd_port_t *port)
+{
+	const port_speed_t *speed = port_speed(port);
+
+	return (speed ? speed->name : "?DR");
+}
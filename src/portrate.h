@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _PORTRATE_H
+#define _PORTRATE_H
+
+#include <infiniband/ibnetdisc.h>
+
+/* The active width and speed of a port, from its PortInfo.
+ *
+ * FDR and faster links report their speed in LinkSpeedExtActive, which is
+ * used when the port supports extended speeds and it is set;
+ * LinkSpeedActive (SDR, DDR, QDR) otherwise.  All
+ * rates are in Mb/s and are 0 when the width or speed is not known.
+ */
+
+/* lanes: 1, 2, 4, 8 or 12 */
+int port_lanes(ibnd_port_t *port);
+
+/* signalling rate of each lane, e.g. 10000 for QDR or 25781 for EDR */
+int port_lane_mbps(ibnd_port_t *port);
+
+/* data rate of the link: all lanes less the 8b/10b (SDR to QDR) or 64b/66b
+ * (FDR on) line encoding */
+int port_data_mbps(ibnd_port_t *port);
+
+/* "4x", "EDR"; "?x" and "?DR" when not known */
+const char *port_width_str(ibnd_port_t *port);
+const char *port_speed_str(ibnd_port_t *port);
+
+#endif /* _PORTRATE_H */
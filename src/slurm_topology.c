@@ -30,6 +30,7 @@
 
 #define _GNU_SOURCE
 #include <ctype.h>
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -40,12 +41,18 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <regex.h>
-#include <complib/cl_nodenamemap.h>
+#include <signal.h>
 #include <infiniband/ibnetdisc.h>
+#include <infiniband/mad.h>
 
 #include "hostlist.h"
-
-#define BUF_SIZE 2048
+#include "guid_index.h"
+#include "outbuf.h"
+#include "arena.h"
+#include "nameset.h"
+#include "stats.h"
+#include "nnmap.h"
+#include "portrate.h"
 
 #ifdef ENABLE_GENDERS
 #include <genders.h>
@@ -55,36 +62,88 @@ char *g_query = "compute";
 
 hostlist_t g_expected_host_list;
 hostlist_t g_host_not_found_list;
+nameset_t *g_expected_host_set; /* marks which expected hosts were found */
 char *expected_hosts = NULL;
 
 char *argv0 = NULL;
 
 static char *node_name_map_file = NULL;
-static nn_map_t *node_name_map = NULL;
+static nnmap_t *node_name_map = NULL;
+static char *load_cache_file = NULL;
 
 /* store the mapping done as a comment for the end of the file */
-char *slurm_name_mapped_output = NULL;
-int slurm_name_mapped_size = 0;
+outbuf_t slurm_name_mapped_output;
+
+/* everything written to the topology file goes through here */
+outbuf_t *g_out = NULL;
+
+/* --watch */
+static int watch_interval = -1;
+static char *on_change_cmd = NULL;
+static sigset_t watch_orig_mask;	/* before the signals were blocked */
 int g_num_levels = -1;
+int g_link_speed = 0;
 
 
 /** =========================================================================
- * Create a little hash of additional node info we need stored.
+ * The links from a switch to one neighboring switch.
+ */
+struct slurm_info;
+typedef struct slurm_link {
+	struct slurm_info *rem_info;
+	int links;
+	int mbps; /* aggregate data rate of the links */
+} slurm_link_t;
+
+/** =========================================================================
+ * Additional node info we need stored.  The records live in one array sized
+ * to the fabric and are found by GUID through info_index.
  */
-#define HTSZ 137
 typedef struct slurm_info {
-	struct slurm_info *htnext;
-	struct slurm_info *level_next;
 	ibnd_node_t *node;
 	int level;
-	char *slurm_name;
+	int order; /* position of a switch in the fabric's switch list */
+	/* from the name map or the node; looked up once by name_nodes() */
+	const char *map_name;
+	/* borrowed from the name map or the node unless renamed ibcoreSWX,
+	 * so valid until the fabric is destroyed */
+	const char *slurm_name;
+	/* sort key for the level; parsed once from slurm_name */
+	int sort_num;
+	int sort_seg;
+	int sort_seq;
+	int sort_nodigit;
+	/* switches and nodes below a switch; what the outputs are written from */
+	hostlist_t down_sw;
+	hostlist_t down_n;
+	/* links to switches above and below, and to nodes; rates in Mb/s */
+	slurm_link_t *nbrs;
+	int num_nbrs;
+	int up_links, up_mbps;
+	int down_links, down_mbps;
+	int node_links, node_mbps;
 } slurm_info_t;
-slurm_info_t *info_hash[HTSZ] = { 0 };
+arena_t *info_arena = NULL; /* infos and renamed switches; freed after output */
+slurm_info_t *infos = NULL;
+int num_infos = 0;
+int max_infos = 0;
+guid_index_t *info_index = NULL;
+
+/* BFS queue of switches; each one is appended exactly once when its level
+ * is assigned so the queue can be sized to the number of switches. */
+slurm_info_t **sw_queue = NULL;
+int sw_queue_len = 0;
+int num_switches = 0;
 
 #define MAX_DEPTH 65
-slurm_info_t *levels[MAX_DEPTH]; /* also store by the level for easier sorting */
-
-#define HASHGUID(guid) ((uint32_t)(((uint32_t)(guid) * 101) ^ ((uint32_t)((guid) >> 32) * 103)))
+/* also store by the level for easier sorting */
+typedef struct slurm_level {
+	slurm_info_t **infos;
+	int num;
+	int size;
+	int num_nodigit;
+} slurm_level_t;
+slurm_level_t levels[MAX_DEPTH];
 
 /** =========================================================================
  * Slurm requires very specific naming for it's config file.  If the fabric
@@ -94,149 +153,231 @@ slurm_info_t *levels[MAX_DEPTH]; /* also store by the level for easier sorting *
  *
  * where X is a number this function will convert the name to "ibcoreSWX"
  */
-char *get_name(ibnd_node_t *node, slurm_info_t *info)
+static int core_num = 1;
+const char *get_name(ibnd_node_t *node, slurm_info_t *info)
 {
-	static int core_num = 1;
 	static int reexp_compiled = 0;
 	static regex_t exp;
 
 	char *re_str = "^[[:alpha:]]*[0-9]*$";
 
 	char buf[64];
-	char comment[256];
+	const char *name = NULL;
 	int rc = 0;
 
 	/* we have already found this name */
 	if (info->slurm_name)
 		return (info->slurm_name);
 
-	info->slurm_name = remap_node_name(node_name_map,
-					node->guid,
-					node->nodedesc);
+	name = info->map_name;
 
 	if (!reexp_compiled) { /* only compile it one time */
 		if ((rc = regcomp(&exp, re_str, REG_ICASE |
 				REG_NOSUB | REG_EXTENDED)) != 0) {
 			fprintf(stderr, "ERROR: regcomp failed on \"%s\": %d\n",
 				re_str, rc);
-			return (info->slurm_name);
+			goto out;
 		}
 		reexp_compiled = 1;
 	}
 
-	if (regexec(&exp, info->slurm_name, 0, NULL, 0) != 0) {
+	if (regexec(&exp, name, 0, NULL, 0) != 0) {
 		snprintf(buf, 64, "ibcoreSW%d", core_num);
 		core_num++;
 
-		snprintf(comment, 256, "#    %s == %s\n",
-			buf, info->slurm_name);
-		comment[255] = '\0';
-		slurm_name_mapped_size += strlen(comment);
-		slurm_name_mapped_output = realloc(slurm_name_mapped_output,
-						slurm_name_mapped_size);
-		if (!slurm_name_mapped_output) {
+		if (outbuf_printf(&slurm_name_mapped_output, "#    %s == %s\n",
+				  buf, name)) {
 			perror("ralloc BADNESS\n");
 			exit(0);
 		}
-		strcat(slurm_name_mapped_output, comment);
 
-		free(info->slurm_name);
-		info->slurm_name = strdup(buf);
+		if (!(info->slurm_name = arena_strdup(info_arena, buf))) {
+			fprintf(stderr, "ERROR: failed to allocate node "
+				"name\n");
+			exit(1);
+		}
 	}
 
+out:
+	if (!info->slurm_name)
+		info->slurm_name = name;
 	return (info->slurm_name);
 }
 
 /** =========================================================================
- * Compare the name n1 to n2 using <prefix>X notation
- * return TRUE if X of n1 is larger than X of n2
- * for example given n1 = host3 and n2 = host1 return 1
- * if n1 != <prefix>X || n2 != <prefix>X
- * Then return 0
+ * Levels are sorted on the X of <prefix>X names; the prefix is ignored.
+ *
+ * The order matches the sorted insertion this replaced: equal X's end up
+ * newest first and a name without an X acts as a barrier, in that names
+ * added after it sort in front of it rather than past it.  So the key is
+ * (barriers seen, X, reverse order of arrival).
  */
+static void
+add_info_to_level(slurm_info_t *info)
+{
+	slurm_level_t *level = &levels[info->level];
+	const char *name = info->slurm_name;
+	int rc = strcspn(name, "0123456789");
+
+	if (level->num == level->size) {
+		level->size = level->size ? level->size * 2 : 64;
+		level->infos = realloc(level->infos,
+				       level->size * sizeof(*level->infos));
+		if (!level->infos) {
+			fprintf(stderr, "ERROR: failed to grow level %d\n",
+				info->level);
+			exit(1);
+		}
+	}
+
+	info->sort_nodigit = (name[rc] == '\0');
+	info->sort_num = info->sort_nodigit ? 0 : atoi(&name[rc]);
+	if (info->sort_nodigit)
+		level->num_nodigit++;
+	info->sort_seg = level->num_nodigit;
+	info->sort_seq = level->num;
+
+	level->infos[level->num++] = info;
+}
+
 static int
-name_larger(char *n1, char *n2)
+level_cmp(const void *a, const void *b)
 {
-	int i1 = 0, i2 = 0;
-	int rc = 0;
+	const slurm_info_t *i1 = *(slurm_info_t **)a;
+	const slurm_info_t *i2 = *(slurm_info_t **)b;
+
+	if (i1->sort_seg != i2->sort_seg)
+		return (i1->sort_seg > i2->sort_seg ? -1 : 1);
+	if (i1->sort_nodigit != i2->sort_nodigit)
+		return (i1->sort_nodigit - i2->sort_nodigit);
+	if (i1->sort_num != i2->sort_num)
+		return (i1->sort_num < i2->sort_num ? -1 : 1);
+	return (i2->sort_seq - i1->sort_seq);
+}
+
+static void
+free_fabric_info(void)
+{
+	int l, i;
+
+	for (l = 0; l < MAX_DEPTH; l++) {
+		for (i = 0; i < levels[l].num; i++) {
+			if (levels[l].infos[i]->down_sw)
+				hostlist_destroy(levels[l].infos[i]->down_sw);
+			if (levels[l].infos[i]->down_n)
+				hostlist_destroy(levels[l].infos[i]->down_n);
+		}
+		free(levels[l].infos);
+		levels[l].infos = NULL;
+		levels[l].num = levels[l].size = levels[l].num_nodigit = 0;
+	}
 
-	rc = strcspn(n1, "0123456789");
-	if (rc == strlen(n2))
-		return (0);
-	i1 = atoi(&n1[rc]);
+	/* the infos and their names all go with the arena */
+	free(sw_queue);
+	sw_queue = NULL;
+	sw_queue_len = 0;
+	num_switches = 0;
+	guid_index_destroy(info_index);
+	info_index = NULL;
+	arena_destroy(info_arena);
+	info_arena = NULL;
+	infos = NULL;
+	num_infos = max_infos = 0;
+}
 
-	rc = strcspn(n2, "0123456789");
-	if (rc == strlen(n2))
-		return (0);
-	i2 = atoi(&n2[rc]);
+static void
+sort_levels(void)
+{
+	int l;
 
-	return (i1 > i2);
+	for (l = 0; l < MAX_DEPTH && levels[l].num; l++)
+		qsort(levels[l].infos, levels[l].num, sizeof(*levels[l].infos),
+		      level_cmp);
 }
 
 /** =========================================================================
  */
-static void
-add_info_to_level(slurm_info_t *info)
+static slurm_info_t *
+create_info(ibnd_node_t *node)
 {
-	slurm_info_t *level_head = levels[info->level];
-	slurm_info_t *level_prev = NULL;
+	slurm_info_t *info = NULL;
 
-	/* sort these as we go */
+	assert(num_infos < max_infos);
 
-	if (!level_head) {
-		info->level_next = NULL;
-		levels[info->level] = info;
-		return;
-	}
+	info = &infos[num_infos];
+	info->node = node;
+	info->level = -1;
 
-	while (level_head && name_larger(info->slurm_name, level_head->slurm_name)) {
-		level_prev = level_head;
-		level_head = level_head->level_next;
+	/* keep track by guid */
+	if (guid_index_insert(info_index, node->guid, num_infos) != 0) {
+		fprintf(stderr, "ERROR: failed to index node 0x%016" PRIx64 "\n",
+			node->guid);
+		exit(1);
 	}
+	num_infos++;
+	return (info);
+}
 
-	info->level_next = level_head;
-	if (level_prev)
-		level_prev->level_next = info;
-	else
-		levels[info->level] = info;
+static slurm_info_t *
+get_info(ibnd_node_t *node)
+{
+	int idx = guid_index_lookup(info_index, node->guid);
+
+	if (idx < 0)
+		return NULL;
+	return (&infos[idx]);
 }
 
 /** =========================================================================
  */
 static void
-add_info(ibnd_node_t *node, int level)
+assign_level(slurm_info_t *info, int level)
 {
-	int hash_idx = HASHGUID(node->guid) % HTSZ;
-	slurm_info_t *info = NULL;
-
 	assert(level < MAX_DEPTH);
 
-	info = calloc(1, sizeof(*info));
-	info->node = node;
 	info->level = level;
-	info->level_next = NULL;
 
 	/* convert the name */
-	get_name(node, info);
+	get_name(info->node, info);
 
 	/* keep track by level */
 	add_info_to_level(info);
 
-	/* keep track by hash */
-	info->htnext = info_hash[hash_idx];
-	info_hash[hash_idx] = info;
+	if (info->node->type == IB_NODE_SWITCH)
+		sw_queue[sw_queue_len++] = info;
 }
-static slurm_info_t *
-get_info(ibnd_node_t *node)
+
+/** =========================================================================
+ * create the (as yet unleveled) info for every switch up front and remember
+ * the order the fabric gives them to us in; then those of the CAs.
+ */
+static void
+index_switch(ibnd_node_t *node, void *user_data)
 {
-	int hash = HASHGUID(node->guid) % HTSZ;
-	slurm_info_t *info;
+	slurm_info_t *info = create_info(node);
+	info->order = num_switches++;
+}
 
-	for (info = info_hash[hash]; info; info = info->htnext)
-		if (info->node->guid == node->guid)
-			return info;
+static void
+index_ca(ibnd_node_t *node, void *user_data)
+{
+	create_info(node);
+}
 
-	return NULL;
+/* Look every node up in the name map in one pass, so the naming phase is
+ * timed once rather than once per node.
+ */
+static void
+name_nodes(void)
+{
+	int i;
+
+	stats_push("naming");
+	for (i = 0; i < num_infos; i++)
+		infos[i].map_name = nnmap_name(node_name_map,
+					       infos[i].node->guid,
+					       infos[i].node->nodedesc);
+	stats_pop();
 }
 
 /** =========================================================================
@@ -245,7 +386,26 @@ static void
 resolve_genders(ibnd_node_t *node)
 {
 	slurm_info_t *slurm_info = get_info(node);
-	hostlist_delete_host(g_host_not_found_list, get_name(node, slurm_info));
+	nameset_mark(g_expected_host_set, get_name(node, slurm_info));
+}
+
+static void
+add_host_not_found(const char *name, void *arg)
+{
+	hostlist_push_host(g_host_not_found_list, name);
+}
+
+/** =========================================================================
+ * Only once all the CAs have been seen turn what is left over in to a
+ * hostlist for printing.
+ */
+static void
+collect_hosts_not_found(void)
+{
+	if (g_host_not_found_list)
+		hostlist_destroy(g_host_not_found_list);
+	g_host_not_found_list = hostlist_create(NULL);
+	nameset_iter_unmarked(g_expected_host_set, add_host_not_found, NULL);
 }
 
 /** =========================================================================
@@ -255,7 +415,7 @@ void process_cas_level(ibnd_node_t *node, void *user_data)
 {
 	int i = 0;
  	/* Ca's are defined to be level 0 */
-	add_info(node, 0);
+	assign_level(get_info(node), 0);
 
 	resolve_genders(node);
 
@@ -263,46 +423,49 @@ void process_cas_level(ibnd_node_t *node, void *user_data)
 	for (i = 1; i <= node->numports; i++) {
 		if (node->ports[i] && node->ports[i]->remoteport) {
 			ibnd_node_t *rem_node = node->ports[i]->remoteport->node;
-			if (rem_node && !get_info(rem_node)) {
-				if (rem_node->type == IB_NODE_SWITCH) {
-					add_info(rem_node, 1);
-				} else if (rem_node->type ==
-					   IB_NODE_CA) {
-					fprintf(stderr, "ERROR: Found a "
-					"node connected to another node\n");
-				}
+			slurm_info_t *rem_info;
+			if (!rem_node)
+				continue;
+			rem_info = get_info(rem_node);
+			if (rem_node->type == IB_NODE_SWITCH) {
+				if (rem_info->level < 0)
+					assign_level(rem_info, 1);
+			} else if (rem_node->type == IB_NODE_CA && !rem_info) {
+				fprintf(stderr, "ERROR: Found a "
+				"node connected to another node\n");
 			}
 		}
 	}
 }
 
 /** =========================================================================
- * finds all switches of level user_data.level and finds the next switches up.
+ * find the next switches up from a switch taken off the BFS queue.
  */
-typedef struct proc_sw_level_user_data {
-	int level;
-	int node_found;
-} proc_sw_level_user_data_t;
-void process_switch_level(ibnd_node_t *node, void *user_data)
+static void
+process_switch_level(slurm_info_t *info)
 {
 	int i = 0;
-	slurm_info_t *info = get_info(node);
-	int level = ((proc_sw_level_user_data_t *)user_data)->level;
-	
-	if (info && info->level == level) {
-		for (i = 1; i <= node->numports; i++) {
-			if (node->ports[i] && node->ports[i]->remoteport) {
-				ibnd_node_t *rem_node = node->ports[i]->remoteport->node;
-				if (rem_node && !get_info(rem_node)
-				    && rem_node->type == IB_NODE_SWITCH) {
-					add_info(rem_node, level + 1);
-					((proc_sw_level_user_data_t *)user_data)->node_found = 1;
-				}
-			}
+	ibnd_node_t *node = info->node;
+
+	for (i = 1; i <= node->numports; i++) {
+		if (node->ports[i] && node->ports[i]->remoteport) {
+			ibnd_node_t *rem_node = node->ports[i]->remoteport->node;
+			slurm_info_t *rem_info;
+			if (!rem_node || rem_node->type != IB_NODE_SWITCH)
+				continue;
+			rem_info = get_info(rem_node);
+			if (rem_info->level < 0)
+				assign_level(rem_info, info->level + 1);
 		}
 	}
 }
 
+static int
+switch_order_cmp(const void *a, const void *b)
+{
+	return ((*(slurm_info_t **)a)->order - (*(slurm_info_t **)b)->order);
+}
+
 ibnd_node_t *get_remote_node(ibnd_node_t *node, int p, slurm_info_t **rem_info)
 {
 	ibnd_node_t *rem_node = NULL;
@@ -313,77 +476,127 @@ ibnd_node_t *get_remote_node(ibnd_node_t *node, int p, slurm_info_t **rem_info)
 	return (rem_node);
 }
 
+/** =========================================================================
+ * write the ranged form of hl; unlike hostlist_ranged_string this is never
+ * truncated no matter how many hosts are in the list.
+ */
+static void
+write_hostlist(outbuf_t *ob, hostlist_t hl)
+{
+	stats_push("hostlists");
+	if (hostlist_ranged_write(hl, outbuf_write_cb, ob) < 0)
+		fprintf(stderr, "ERROR: failed to write hostlist\n");
+	stats_pop();
+}
+
 /** =========================================================================
  */
 static void
 print_virtual_top(int level)
 {
 	hostlist_t last_level = hostlist_create(NULL);
-	slurm_info_t *info = levels[level];
-	char hl_str[BUF_SIZE];
-	hl_str[0] = '\0';
+	slurm_info_t *info;
+	int i = 0;
 
-	while (info) {
+	for (i = 0; i < levels[level].num; i++) {
+		info = levels[level].infos[i];
 		hostlist_push_host(last_level, get_name(info->node, info));
-		info = info->level_next;
 	}
 
-	printf("\n# \"Virtual Top\"\n");
-	if (hostlist_ranged_string(last_level, BUF_SIZE, hl_str) > 0) {
-		printf("SwitchName=VirtualTop1 Switches=%s\n", hl_str);
+	outbuf_printf(g_out, "\n# \"Virtual Top\"\n");
+	if (!hostlist_is_empty(last_level)) {
+		outbuf_puts(g_out, "SwitchName=VirtualTop1 Switches=");
+		write_hostlist(g_out, last_level);
+		outbuf_putc(g_out, '\n');
 	} else {
-		printf("ERROR creation of virtual top failed; hostlist_ranged_string\n");
+		outbuf_printf(g_out, "ERROR creation of virtual top failed; no switches found\n");
 	}
+	hostlist_destroy(last_level);
 }
 
 /** =========================================================================
+ * Count a link from info to rem_info; parallel links to the same switch
+ * are combined.
  */
-static void print_switches(void)
+static void add_link(slurm_info_t *info, slurm_info_t *rem_info, int mbps)
 {
-	hostlist_t sw_list = hostlist_create(NULL);
-	char sw_hl_str[BUF_SIZE];
-	hostlist_t n_list = hostlist_create(NULL);
-	char n_hl_str[BUF_SIZE];
-	hostlist_iterator_t it;
-	char *name = NULL;
+	int k;
 
+	if (rem_info->node->type != IB_NODE_SWITCH) {
+		info->node_links++;
+		info->node_mbps += mbps;
+		return;
+	}
+
+	if (rem_info->level > info->level) {
+		info->up_links++;
+		info->up_mbps += mbps;
+	} else if (rem_info->level < info->level) {
+		info->down_links++;
+		info->down_mbps += mbps;
+	}
+
+	for (k = 0; k < info->num_nbrs; k++)
+		if (info->nbrs[k].rem_info == rem_info)
+			break;
+	if (k == info->num_nbrs) {
+		info->nbrs[k].rem_info = rem_info;
+		info->nbrs[k].links = 0;
+		info->nbrs[k].mbps = 0;
+		info->num_nbrs++;
+	}
+	info->nbrs[k].links++;
+	info->nbrs[k].mbps += mbps;
+}
+
+/** =========================================================================
+ * Find the switches and nodes below (down ports of) every switch and
+ * count the links of each.
+ */
+static void build_down_lists(void)
+{
 	ibnd_node_t *node;
 	ibnd_node_t *rem_node;
 	slurm_info_t *rem_info;
 
 	int level = 1;
 	int i = 0;
-	char *node_name = NULL;
-	char *rem_node_name = NULL;
-
-	for (level = 1; levels[level]; level++) {
-		/* only report the number of levels the user wants */
-		if (g_num_levels != -1 && level > g_num_levels) {
-			print_virtual_top(level-1);
-			break;
-		}
+	int j = 0;
+	const char *node_name = NULL;
+	const char *rem_node_name = NULL;
 
-		printf("\n# Begin switches at level %d\n", level);
-		slurm_info_t *info = levels[level];
-		while (info) {
+	for (level = 1; level < MAX_DEPTH && levels[level].num; level++) {
+		for (j = 0; j < levels[level].num; j++) {
+			slurm_info_t *info = levels[level].infos[j];
 			node = info->node;
 
 			node_name = get_name(node, info);
-			printf("SwitchName=%s ", node_name);
+			info->down_sw = hostlist_create(NULL);
+			info->down_n = hostlist_create(NULL);
+			info->nbrs = arena_alloc(info_arena, (node->numports + 1)
+						 * sizeof(*info->nbrs));
+			if (!info->nbrs) {
+				fprintf(stderr, "ERROR: failed to allocate "
+					"links for %s\n", node_name);
+				exit(1);
+			}
 
 			for (i = 1; i <= node->numports; i++) {
 				rem_node = get_remote_node(node, i, &rem_info);
 				if (!rem_node)
 					continue;
 
+				add_link(info, rem_info,
+					 port_data_mbps(node->ports[i]));
+
 				rem_node_name = get_name(rem_node, rem_info);
 
 				/* find all the down (direction) ports */
 				if (rem_info->level < level) {
 					if (rem_node->type == IB_NODE_SWITCH) {
-						hostlist_push(sw_list, rem_node_name);
+						hostlist_push(info->down_sw, rem_node_name);
 					} else if (rem_node->type == IB_NODE_CA) {
-						hostlist_push(n_list, rem_node_name);
+						hostlist_push(info->down_n, rem_node_name);
 					}
 				} else if (rem_info->level == level) {
 					fprintf(stderr, "WARNING: found "
@@ -393,34 +606,102 @@ static void print_switches(void)
 				}
 			}
 
-			hostlist_sort(sw_list);
-			hostlist_sort(n_list);
+			/* parallel links are counted in nbrs; list each
+			 * switch once */
+			hostlist_uniq(info->down_sw);
+			hostlist_sort(info->down_n);
+		}
+	}
+}
 
-			if (hostlist_ranged_string(sw_list, BUF_SIZE, sw_hl_str) > 0)
-				printf("Switches=%s ", sw_hl_str);
+/** =========================================================================
+ * Annotate a switch entry with the links to each neighboring switch.
+ */
+static void print_links(slurm_info_t *info)
+{
+	int k;
+
+	for (k = 0; k < info->num_nbrs; k++) {
+		slurm_link_t *l = &info->nbrs[k];
+
+		outbuf_printf(g_out, "#    %s %s: %d link%s %g Gb/s\n",
+			      l->rem_info->level > info->level ? "up" : "down",
+			      l->rem_info->slurm_name, l->links,
+			      l->links == 1 ? "" : "s", l->mbps / 1000.0);
+	}
+}
 
-			if (hostlist_ranged_string(n_list, BUF_SIZE, n_hl_str) > 0)
-				printf("Nodes=%s ", n_hl_str);
+/** =========================================================================
+ */
+static void print_switches(void)
+{
+	int level = 1;
+	int j = 0;
 
-			it = hostlist_iterator_create(sw_list);
-			for (name = hostlist_next(it);
-				name != NULL; name = hostlist_next(it)) {
-				hostlist_remove(it);
+	for (level = 1; level < MAX_DEPTH && levels[level].num; level++) {
+		/* only report the number of levels the user wants */
+		if (g_num_levels != -1 && level > g_num_levels) {
+			print_virtual_top(level-1);
+			break;
+		}
+
+		outbuf_printf(g_out, "\n# Begin switches at level %d\n", level);
+		for (j = 0; j < levels[level].num; j++) {
+			slurm_info_t *info = levels[level].infos[j];
+
+			outbuf_puts(g_out, "SwitchName=");
+			outbuf_puts(g_out, info->slurm_name);
+			outbuf_putc(g_out, ' ');
+
+			if (!hostlist_is_empty(info->down_sw)) {
+				outbuf_puts(g_out, "Switches=");
+				write_hostlist(g_out, info->down_sw);
+				outbuf_putc(g_out, ' ');
 			}
-			hostlist_iterator_destroy(it);
 
-			it = hostlist_iterator_create(n_list);
-			for (name = hostlist_next(it);
-				name != NULL; name = hostlist_next(it)) {
-				hostlist_remove(it);
+			if (!hostlist_is_empty(info->down_n)) {
+				outbuf_puts(g_out, "Nodes=");
+				write_hostlist(g_out, info->down_n);
+				outbuf_putc(g_out, ' ');
 			}
-			hostlist_iterator_destroy(it);
 
-			printf("\n");
+			/* the switch's link to the level above */
+			if (g_link_speed && info->up_mbps)
+				outbuf_printf(g_out, "LinkSpeed=%d ",
+					      info->up_mbps);
+
+			outbuf_putc(g_out, '\n');
 
-			info = info->level_next;
+			if (g_link_speed)
+				print_links(info);
 		}
-		printf("# End switches at level %d\n", level);
+		outbuf_printf(g_out, "# End switches at level %d\n", level);
+	}
+}
+
+/** =========================================================================
+ * Report the ratio of node to uplink bandwidth for each leaf switch.
+ */
+static void print_oversubscription(void)
+{
+	int j = 0;
+
+	outbuf_puts(g_out, "\n# Leaf oversubscription (node : uplink bandwidth)\n");
+	for (j = 0; j < levels[1].num; j++) {
+		slurm_info_t *info = levels[1].infos[j];
+
+		if (!info->node_links)
+			continue;
+		outbuf_printf(g_out, "#    %s: %d nodes %g Gb/s, "
+			      "%d uplinks %g Gb/s, ",
+			      info->slurm_name,
+			      info->node_links, info->node_mbps / 1000.0,
+			      info->up_links, info->up_mbps / 1000.0);
+		if (info->up_mbps)
+			outbuf_printf(g_out, "%.2f:1\n",
+				      (double)info->node_mbps / info->up_mbps);
+		else
+			outbuf_puts(g_out, "no uplinks\n");
 	}
 }
 
@@ -428,45 +709,46 @@ static void print_switches(void)
  */
 static void print_missing_hosts(void)
 {
-	char hl_str[BUF_SIZE];
-	hl_str[0] = '\0';
+	if (hostlist_is_empty(g_host_not_found_list))
+		return;
+
+	outbuf_printf(g_out, "\n#\n# ERROR: failed to find these expected nodes in the fabric: ");
+	write_hostlist(g_out, g_host_not_found_list);
+	outbuf_printf(g_out, "\n#\n");
+}
+
+/* once per scan, however many outputs are written */
+static void report_missing_hosts(void)
+{
+	outbuf_t hl_str;
 
 	if (hostlist_is_empty(g_host_not_found_list))
 		return;
 
 	hostlist_sort(g_host_not_found_list);
 
-	/* print this to both the output file and stderr */
-	printf("\n#\n# ERROR: failed to find these expected nodes in the fabric: ");
-	if (hostlist_ranged_string(g_host_not_found_list, BUF_SIZE, hl_str) > 0) {
-		printf("%s\n", hl_str);
-	} else {
-		printf("(ERROR \"hostlist_ranged_string\" failed)\n");
-	}
-	printf("#\n");
-
+	outbuf_init(&hl_str, NULL);
+	write_hostlist(&hl_str, g_host_not_found_list);
 	fprintf(stderr,
 		"\nERROR: failed to find these expected nodes in the fabric: %s\n",
-		hl_str);
+		hl_str.buf ? hl_str.buf : "");
+	outbuf_free(&hl_str);
 }
 
-static void print_header(void)
+static void print_header(const char *title)
 {
 	time_t ltime;
 	ltime=time(NULL);
 
-	printf("# Slurm Topology %s", asctime(localtime(&ltime)));
+	outbuf_printf(g_out, "# %s %s", title, asctime(localtime(&ltime)));
 
-	printf("# Expected hosts: ");
+	outbuf_printf(g_out, "# Expected hosts: ");
 	if (hostlist_is_empty(g_expected_host_list))
-		printf("<none>\n");
+		outbuf_printf(g_out, "<none>\n");
 	else {
-		char hl_str[BUF_SIZE];
 		hostlist_sort(g_expected_host_list);
-		if (hostlist_ranged_string(g_expected_host_list, BUF_SIZE, hl_str) > 0)
-			printf("%s\n", hl_str);
-		else
-			printf("<ERROR \"hostlist_ranged_string\" failed>\n");
+		write_hostlist(g_out, g_expected_host_list);
+		outbuf_putc(g_out, '\n');
 	}
 
 	print_missing_hosts();
@@ -476,34 +758,649 @@ static void print_header(void)
  */
 static void process_fabric(ibnd_fabric_t *fabric)
 {
-	proc_sw_level_user_data_t user_data;
+	int head = 0;
+	int tail = 0;
+	ibnd_node_t *node;
+
+	stats_push("levels");
+
+	/* start from scratch; in watch mode we are called once per scan */
+	core_num = 1;
+	nameset_clear_marks(g_expected_host_set);
+
+	for (node = fabric->nodes; node; node = node->next)
+		max_infos++;
+	info_arena = arena_create(0);
+	if (info_arena)
+		infos = arena_calloc(info_arena, max_infos + 1, sizeof(*infos));
+	info_index = guid_index_create(max_infos);
+	if (!infos || !info_index) {
+		fprintf(stderr, "ERROR: failed to allocate node info for %d "
+			"nodes\n", max_infos);
+		exit(1);
+	}
 
-	slurm_name_mapped_output = malloc(1);
-	slurm_name_mapped_output[0] = '\0';
-	slurm_name_mapped_size = 1;
+	outbuf_init(&slurm_name_mapped_output, NULL);
+
+	ibnd_iter_nodes_type(fabric, index_switch, IB_NODE_SWITCH, NULL);
+	ibnd_iter_nodes_type(fabric, index_ca, IB_NODE_CA, NULL);
+	name_nodes();
+	sw_queue = calloc(num_switches + 1, sizeof(*sw_queue));
+	if (!sw_queue) {
+		fprintf(stderr, "ERROR: failed to allocate switch queue\n");
+		exit(1);
+	}
 
 	ibnd_iter_nodes_type(fabric, process_cas_level, IB_NODE_CA, NULL);
 
-	user_data.level = 0;
-	user_data.node_found = 0;
+	/* Breadth first from the level 1 switches found above.  Each pass of
+	 * the loop consumes one level of the queue while appending the next.
+	 * The level is walked in fabric order so that the names handed out by
+	 * get_name (ibcoreSWX) do not depend on the order of the queue.
+	 */
+	while (head < sw_queue_len) {
+		tail = sw_queue_len;
+		qsort(&sw_queue[head], tail - head, sizeof(*sw_queue),
+		      switch_order_cmp);
+		for (; head < tail; head++)
+			process_switch_level(sw_queue[head]);
+	}
+
+	stats_push("sorting");
+	sort_levels();
+	stats_pop();
+
+	stats_push("hostlists");
+	collect_hosts_not_found();
+	report_missing_hosts();
+	build_down_lists();
+	stats_pop();
+
+	stats_pop();
+}
+
+/** =========================================================================
+ */
+static void done_with_fabric(void)
+{
+	outbuf_free(&slurm_name_mapped_output);
+	free_fabric_info();
+}
 
-	do {
-		user_data.level++;
-		user_data.node_found = 0;
-		ibnd_iter_nodes_type(fabric, process_switch_level,
-				     IB_NODE_SWITCH, &user_data);
-	} while (user_data.node_found);
+/** =========================================================================
+ * Output formats.  Each writes the level data built by process_fabric.
+ */
+static void print_remapped_names(void)
+{
+	outbuf_puts(g_out, "\n# Slurm Remapped Names\n");
+	outbuf_append(g_out, slurm_name_mapped_output.buf,
+		      slurm_name_mapped_output.len);
+}
 
-	print_header();
+/* topology.conf for topology/tree */
+static void write_slurm_tree(void)
+{
+	print_header("Slurm Topology");
 	print_switches();
+	if (g_link_speed)
+		print_oversubscription();
+	print_remapped_names();
+}
+
+/* topology.conf for topology/block; a block is the nodes of one leaf */
+static void write_slurm_block(void)
+{
+	int j = 0;
+
+	print_header("Slurm Block Topology");
+
+	outbuf_puts(g_out, "\n# Begin blocks (level 1 switches)\n");
+	for (j = 0; j < levels[1].num; j++) {
+		slurm_info_t *info = levels[1].infos[j];
+
+		if (hostlist_is_empty(info->down_n))
+			continue;
+		outbuf_puts(g_out, "BlockName=");
+		outbuf_puts(g_out, info->slurm_name);
+		outbuf_puts(g_out, " Nodes=");
+		write_hostlist(g_out, info->down_n);
+		outbuf_putc(g_out, '\n');
+	}
+	outbuf_puts(g_out, "# End blocks\n");
+
+	print_remapped_names();
+}
+
+static void write_json_string(const char *str)
+{
+	const unsigned char *c;
+
+	outbuf_putc(g_out, '"');
+	for (c = (const unsigned char *)str; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			outbuf_putc(g_out, '\\');
+			outbuf_putc(g_out, *c);
+		} else if (*c < 0x20) {
+			outbuf_printf(g_out, "\\u%04x", *c);
+		} else {
+			outbuf_putc(g_out, *c);
+		}
+	}
+	outbuf_putc(g_out, '"');
+}
+
+static void write_json_hostlist(hostlist_t hl)
+{
+	hostlist_iterator_t it = hostlist_iterator_create(hl);
+	char *host;
+	int first = 1;
+
+	outbuf_putc(g_out, '[');
+	while ((host = hostlist_next(it)) != NULL) {
+		if (!first)
+			outbuf_puts(g_out, ", ");
+		write_json_string(host);
+		free(host);
+		first = 0;
+	}
+	hostlist_iterator_destroy(it);
+	outbuf_putc(g_out, ']');
+}
+
+static void write_json_links(slurm_info_t *info)
+{
+	int k;
+
+	outbuf_putc(g_out, '[');
+	for (k = 0; k < info->num_nbrs; k++) {
+		slurm_link_t *l = &info->nbrs[k];
+
+		outbuf_puts(g_out, k ? ", {\"name\": " : "{\"name\": ");
+		write_json_string(l->rem_info->slurm_name);
+		outbuf_printf(g_out, ", \"links\": %d, \"mbps\": %d}",
+			      l->links, l->mbps);
+	}
+	outbuf_putc(g_out, ']');
+}
+
+/* every level; names are those used in the slurm formats */
+static void write_json(void)
+{
+	int level = 1;
+	int j = 0;
+
+	outbuf_puts(g_out, "{\n  \"levels\": [");
+	for (level = 1; level < MAX_DEPTH && levels[level].num; level++) {
+		outbuf_printf(g_out, "%s\n    {\"level\": %d, \"switches\": [",
+			      level > 1 ? "," : "", level);
+		for (j = 0; j < levels[level].num; j++) {
+			slurm_info_t *info = levels[level].infos[j];
+
+			outbuf_printf(g_out, "%s\n      {\"name\": ",
+				      j ? "," : "");
+			write_json_string(info->slurm_name);
+			outbuf_printf(g_out, ", \"guid\": \"0x%016" PRIx64 "\", "
+				      "\"nodedesc\": ", info->node->guid);
+			write_json_string(info->node->nodedesc);
+			outbuf_printf(g_out, ",\n       \"up_links\": %d, "
+				      "\"up_mbps\": %d, "
+				      "\"node_links\": %d, \"node_mbps\": %d",
+				      info->up_links, info->up_mbps,
+				      info->node_links, info->node_mbps);
+			outbuf_puts(g_out, ",\n       \"links\": ");
+			write_json_links(info);
+			outbuf_puts(g_out, ",\n       \"switches\": ");
+			write_json_hostlist(info->down_sw);
+			outbuf_puts(g_out, ",\n       \"nodes\": ");
+			write_json_hostlist(info->down_n);
+			outbuf_putc(g_out, '}');
+		}
+		outbuf_puts(g_out, "\n    ]}");
+	}
+	outbuf_puts(g_out, "\n  ],\n  \"missing_hosts\": ");
+	write_json_hostlist(g_host_not_found_list);
+	outbuf_puts(g_out, "\n}\n");
+}
+
+/* one host per line grouped by leaf switch, e.g. for MPI rank ordering */
+static void write_hostfile(void)
+{
+	hostlist_iterator_t it;
+	char *host;
+	int j = 0;
+
+	for (j = 0; j < levels[1].num; j++) {
+		slurm_info_t *info = levels[1].infos[j];
+
+		if (hostlist_is_empty(info->down_n))
+			continue;
+		outbuf_printf(g_out, "# %s\n", info->slurm_name);
+		it = hostlist_iterator_create(info->down_n);
+		while ((host = hostlist_next(it)) != NULL) {
+			outbuf_puts(g_out, host);
+			outbuf_putc(g_out, '\n');
+			free(host);
+		}
+		hostlist_iterator_destroy(it);
+	}
+}
+
+typedef struct topo_format {
+	const char *name;
+	void (*write)(void);
+	/* lines which make up the structure of the output (see
+	 * hash_topology); NULL == every line */
+	const char *entry_prefix;
+} topo_format_t;
+
+static topo_format_t topo_formats[] = {
+	{ "slurm-tree", write_slurm_tree, "SwitchName=" },
+	{ "slurm-block", write_slurm_block, "BlockName=" },
+	{ "json", write_json, NULL },
+	{ "hostfile", write_hostfile, NULL },
+	{ NULL, NULL, NULL }
+};
+
+/* write one format in to out */
+static void write_format(topo_format_t *format, outbuf_t *out)
+{
+	g_out = out;
+	format->write();
+	g_out = NULL;
+}
+
+/** =========================================================================
+ */
+static ibnd_fabric_t *
+load_fabric(char *ibd_ca, int ibd_ca_port, struct ibnd_config *config)
+{
+	ibnd_fabric_t *fabric = NULL;
+
+	stats_push("discovery");
+	if (load_cache_file) {
+		if ((fabric = ibnd_load_fabric(load_cache_file, 0)) == NULL)
+			fprintf(stderr, "loading cached fabric \"%s\" failed\n",
+				load_cache_file);
+	} else {
+		if ((fabric = ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL,
+						   config)) == NULL)
+			fprintf(stderr, "ibnd_discover_fabric failed\n");
+	}
+	stats_pop();
+
+	if (fabric)
+		stats_fabric(fabric);
+	return (fabric);
+}
+
+/** =========================================================================
+ * Write the topology to file by way of a temporary file in the same
+ * directory so slurm never sees a partial file.
+ */
+static int
+write_topology_file(const char *file, outbuf_t *out)
+{
+	char *tmp = NULL;
+	FILE *fp;
+	int rc = -1;
+
+	if (asprintf(&tmp, "%s.tmp.%d", file, (int)getpid()) < 0) {
+		fprintf(stderr, "ERROR: failed to allocate file name\n");
+		return (-1);
+	}
+
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		fprintf(stderr, "ERROR: failed to open \"%s\": %s\n",
+			tmp, strerror(errno));
+		goto out;
+	}
 
-	printf("\n# Slurm Remapped Names\n%s", slurm_name_mapped_output);
+	if (fwrite(out->buf, 1, out->len, fp) != out->len
+	    || fflush(fp) || fsync(fileno(fp))) {
+		fprintf(stderr, "ERROR: failed to write \"%s\": %s\n",
+			tmp, strerror(errno));
+		fclose(fp);
+		unlink(tmp);
+		goto out;
+	}
+
+	if (fclose(fp)) {
+		fprintf(stderr, "ERROR: failed to close \"%s\": %s\n",
+			tmp, strerror(errno));
+		unlink(tmp);
+		goto out;
+	}
+
+	if (rename(tmp, file)) {
+		fprintf(stderr, "ERROR: failed to rename \"%s\" to \"%s\": %s\n",
+			tmp, file, strerror(errno));
+		unlink(tmp);
+		goto out;
+	}
+	rc = 0;
+out:
+	free(tmp);
+	return (rc);
+}
+
+/** =========================================================================
+ * The structure of a topology is the set of its SwitchName entries; the
+ * comments (time stamp, missing hosts, remapped names) do not matter to
+ * slurm.  Keep a sorted hash of each entry so two topologies can be
+ * compared without keeping the text around.
+ */
+typedef struct topo_hash {
+	uint64_t *entries;
+	int num;
+	int size;
+	int valid;
+} topo_hash_t;
+
+static uint64_t
+hash_entry(const char *str, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL; /* FNV-1a */
+
+	while (len--) {
+		h ^= (unsigned char)*str++;
+		h *= 1099511628211ULL;
+	}
+	return (h);
+}
+
+static int
+entry_cmp(const void *a, const void *b)
+{
+	uint64_t e1 = *(uint64_t *)a;
+	uint64_t e2 = *(uint64_t *)b;
+	return (e1 < e2 ? -1 : e1 > e2);
+}
+
+static void
+hash_topology(const char *buf, size_t len, const char *prefix,
+	      topo_hash_t *th)
+{
+	const char *end = buf + len;
+	const char *line, *eol;
+
+	th->num = 0;
+	th->valid = 1;
+	for (line = buf; line < end; line = eol + 1) {
+		if ((eol = memchr(line, '\n', end - line)) == NULL)
+			eol = end;
+		if (prefix && strncmp(line, prefix, strlen(prefix)) != 0)
+			continue;
+		if (!prefix && line == eol)
+			continue;
+		if (th->num == th->size) {
+			th->size = th->size ? th->size * 2 : 256;
+			th->entries = realloc(th->entries,
+					      th->size * sizeof(*th->entries));
+			if (!th->entries) {
+				fprintf(stderr, "ERROR: failed to allocate "
+					"topology hash\n");
+				exit(1);
+			}
+		}
+		th->entries[th->num++] = hash_entry(line, eol - line);
+	}
+	qsort(th->entries, th->num, sizeof(*th->entries), entry_cmp);
+}
+
+/* the number of entries in only one of a or b */
+static int
+topology_changes(topo_hash_t *a, topo_hash_t *b)
+{
+	int i = 0, j = 0, changes = 0;
+
+	if (!a->valid || !b->valid)
+		return (a->valid == b->valid ? 0 : -1);
+
+	while (i < a->num && j < b->num) {
+		if (a->entries[i] == b->entries[j]) {
+			i++;
+			j++;
+		} else if (a->entries[i] < b->entries[j]) {
+			i++;
+			changes++;
+		} else {
+			j++;
+			changes++;
+		}
+	}
+	return (changes + (a->num - i) + (b->num - j));
+}
+
+static void
+hash_topology_file(const char *file, const char *prefix, topo_hash_t *th)
+{
+	outbuf_t buf;
+	char tmp[8192];
+	size_t n;
+	FILE *fp;
+
+	th->valid = 0;
+	if ((fp = fopen(file, "r")) == NULL)
+		return;
+
+	outbuf_init(&buf, NULL);
+	while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0)
+		outbuf_append(&buf, tmp, n);
+	if (!ferror(fp) && !buf.error)
+		hash_topology(buf.buf, buf.len, prefix, th);
+	fclose(fp);
+	outbuf_free(&buf);
+}
+
+/** =========================================================================
+ * --output [<format>:]<file>; may be given more than once so one scan can
+ * feed every consumer.
+ */
+#define MAX_OUTPUTS 16
+typedef struct topo_output {
+	topo_format_t *format;
+	char *file;	/* "-" == stdout */
+	topo_hash_t hash;
+} topo_output_t;
+static topo_output_t outputs[MAX_OUTPUTS];
+static int num_outputs = 0;
+
+static void add_output(char *arg)
+{
+	topo_format_t *format = &topo_formats[0];
+	char *colon = strchr(arg, ':');
+	int i;
+
+	if (num_outputs >= MAX_OUTPUTS) {
+		fprintf(stderr, "ERROR: at most %d outputs may be given\n",
+			MAX_OUTPUTS);
+		exit(1);
+	}
+
+	/* a file name alone is written as slurm-tree; a colon after a '/'
+	 * is part of the file name */
+	if (colon && !memchr(arg, '/', colon - arg)) {
+		for (i = 0; topo_formats[i].name; i++) {
+			if (strlen(topo_formats[i].name) == colon - arg
+			    && strncmp(topo_formats[i].name, arg,
+				       colon - arg) == 0)
+				break;
+		}
+		if (!topo_formats[i].name) {
+			fprintf(stderr, "ERROR: unknown output format \"%.*s\"; "
+				"valid formats are:", (int)(colon - arg), arg);
+			for (i = 0; topo_formats[i].name; i++)
+				fprintf(stderr, " %s", topo_formats[i].name);
+			fprintf(stderr, "\n");
+			exit(1);
+		}
+		format = &topo_formats[i];
+		arg = colon + 1;
+	}
+
+	outputs[num_outputs].format = format;
+	outputs[num_outputs].file = strdup(arg);
+	num_outputs++;
+}
+
+/* run --on-change with the signal mask from before --watch blocked its
+ * signals, which the command would otherwise inherit */
+static void run_on_change(void)
+{
+	sigset_t blocked;
+
+	sigprocmask(SIG_SETMASK, &watch_orig_mask, &blocked);
+	if (system(on_change_cmd) != 0)
+		fprintf(stderr, "WARNING: \"%s\" failed\n", on_change_cmd);
+	sigprocmask(SIG_SETMASK, &blocked, NULL);
+}
+
+/* write each output from the current level data
+ * returns the number of outputs which failed */
+static int write_outputs(int only_changed)
+{
+	topo_hash_t next = { 0 };
+	topo_hash_t swap;
+	outbuf_t out;
+	int i, changes, rc = 0, updated = 0;
+
+	stats_push("output");
+	for (i = 0; i < num_outputs; i++) {
+		topo_output_t *o = &outputs[i];
+
+		if (strcmp(o->file, "-") == 0) {
+			outbuf_init(&out, stdout);
+			write_format(o->format, &out);
+			if (outbuf_flush(&out)) {
+				fprintf(stderr, "ERROR: failed to write "
+					"topology: %s\n", strerror(errno));
+				rc++;
+			}
+			outbuf_free(&out);
+			continue;
+		}
+
+		/* a file is written whole so it can be renamed in to place */
+		outbuf_init(&out, NULL);
+		write_format(o->format, &out);
+		if (out.error) {
+			fprintf(stderr, "ERROR: failed to generate %s\n",
+				o->file);
+			rc++;
+			goto next;
+		}
+
+		if (only_changed) {
+			hash_topology(out.buf, out.len,
+				      o->format->entry_prefix, &next);
+			if ((changes = topology_changes(&o->hash, &next)) == 0)
+				goto next;
+			if (changes < 0)
+				fprintf(stderr, "writing %s\n", o->file);
+			else
+				fprintf(stderr, "%d %s entries changed; "
+					"updating %s\n", changes,
+					o->format->name, o->file);
+		}
+
+		if (write_topology_file(o->file, &out)) {
+			rc++;
+			goto next;
+		}
+		updated++;
+
+		if (only_changed) {
+			swap = o->hash;
+			o->hash = next;
+			next = swap;
+		}
+next:
+		outbuf_free(&out);
+	}
+	free(next.entries);
+	stats_pop();
+
+	if (only_changed && updated && on_change_cmd)
+		run_on_change();
+	return (rc);
+}
+
+/** =========================================================================
+ * --watch: rescan every watch_interval seconds (or only on SIGHUP if that
+ * is 0) and replace each output file only when its entries change.
+ */
+static volatile sig_atomic_t g_rescan = 0;
+static volatile sig_atomic_t g_stop = 0;
+
+static void
+watch_signal(int sig)
+{
+	if (sig == SIGHUP || sig == SIGALRM)
+		g_rescan = 1;
+	else
+		g_stop = 1;
+}
+
+static int
+watch_fabric(char *ibd_ca, int ibd_ca_port, struct ibnd_config *config)
+{
+	struct sigaction sa;
+	sigset_t block;
+	ibnd_fabric_t *fabric;
+	int i;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watch_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGHUP, &sa, NULL);
+	sigaction(SIGALRM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	/* signals are only taken while waiting in sigsuspend */
+	sigemptyset(&block);
+	sigaddset(&block, SIGHUP);
+	sigaddset(&block, SIGALRM);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	sigprocmask(SIG_BLOCK, &block, &watch_orig_mask);
+
+	/* don't rewrite files which are already up to date on startup */
+	for (i = 0; i < num_outputs; i++)
+		hash_topology_file(outputs[i].file,
+				   outputs[i].format->entry_prefix,
+				   &outputs[i].hash);
+
+	while (!g_stop) {
+		g_rescan = 0;
+
+		if ((fabric = load_fabric(ibd_ca, ibd_ca_port, config))) {
+			process_fabric(fabric);
+			write_outputs(1);
+			ibnd_destroy_fabric(fabric);
+			done_with_fabric();
+			stats_report(stderr);
+		}
+
+		if (watch_interval > 0)
+			alarm(watch_interval);
+		while (!g_rescan && !g_stop)
+			sigsuspend(&watch_orig_mask);
+		alarm(0);
+	}
+
+	sigprocmask(SIG_SETMASK, &watch_orig_mask, NULL);
+	for (i = 0; i < num_outputs; i++)
+		free(outputs[i].hash.entries);
+	return (0);
 }
 
 /** =========================================================================
  */
 static void load_expected_host_list(void)
 {
+	hostlist_iterator_t it;
+	char *host;
 #ifdef ENABLE_GENDERS
 	genders_t genders;
 	char **node_list;
@@ -544,7 +1441,20 @@ static void load_expected_host_list(void)
 #endif /* ENABLE_GENDERS */
 
 done:
-	g_host_not_found_list = hostlist_copy(g_expected_host_list);
+	g_expected_host_set = nameset_create(hostlist_count(g_expected_host_list));
+	if (!g_expected_host_set) {
+		fprintf(stderr, "ERROR: failed to allocate expected host set\n");
+		exit(1);
+	}
+	it = hostlist_iterator_create(g_expected_host_list);
+	while ((host = hostlist_next(it)) != NULL) {
+		if (nameset_add(g_expected_host_set, host)) {
+			fprintf(stderr, "ERROR: failed to add expected host\n");
+			exit(1);
+		}
+		free(host);
+	}
+	hostlist_iterator_destroy(it);
 }
 
 /** =========================================================================
@@ -552,7 +1462,9 @@ done:
 static void destroy_expected_host_list(void)
 {
 	hostlist_destroy(g_expected_host_list);
-	hostlist_destroy(g_host_not_found_list);
+	if (g_host_not_found_list)
+		hostlist_destroy(g_host_not_found_list);
+	nameset_destroy(g_expected_host_set);
 }
 
 /** =========================================================================
@@ -576,6 +1488,27 @@ usage(void)
 "\n"
 #endif /* ENABLE_GENDERS */
 "  --node-name-map <map> specify alternate node name map\n"
+"  --load-cache <file>   build the topology from an ibnetdiscover cache file\n"
+"                        rather than scanning the fabric\n"
+"  --output, -o [<fmt>:]<file>\n"
+"                        write the topology to <file> (replaced atomically)\n"
+"                        rather than stdout; may be given more than once.\n"
+"                        <fmt> is one of slurm-tree (default), slurm-block,\n"
+"                        json or hostfile (hosts grouped by leaf switch).\n"
+"                        A <file> of \"-\" is stdout; give a <fmt> or a\n"
+"                        path (e.g. ./<file>) for a <file> with a colon\n"
+"  --watch <secs>        rescan every <secs> seconds (0 == only on SIGHUP)\n"
+"                        and replace each --output file only when its\n"
+"                        entries change\n"
+"  --on-change <cmd>     run <cmd> after --watch replaces any file\n"
+"                        (e.g. \"scontrol reconfigure\")\n"
+"  --link-speed          add the aggregate uplink rate (Mb/s) of each switch\n"
+"                        as LinkSpeed, annotate the links between switches\n"
+"                        and report leaf oversubscription (slurm-tree)\n"
+"  --stats               print to stderr the time, growth of the heap in use\n"
+"                        in KB (not a count of allocations) and times\n"
+"                        entered of each phase, and the node, port and\n"
+"                        link counts\n"
 "  --Ca, -C <ca>         Ca name to use\n"
 "  --Port, -P <port>     Ca port number to use\n"
 "  --timeout, -t <ms>    timeout in ms\n"
@@ -595,6 +1528,7 @@ usage(void)
 int main(int argc, char **argv)
 {
 	int rc = 0;
+	int i = 0;
 	ibnd_fabric_t *fabric = NULL;
 	char *ibd_ca = NULL;
 	int ibd_ca_port = 0;
@@ -604,9 +1538,9 @@ int main(int argc, char **argv)
         char  ch = 0;
 
 #ifdef ENABLE_GENDERS
-        static char const str_opts[] = "hC:P:t:vn:g:q:";
+        static char const str_opts[] = "hC:P:t:vn:o:g:q:";
 #else /* !ENABLE_GENDERS */
-        static char const str_opts[] = "hC:P:t:vn:";
+        static char const str_opts[] = "hC:P:t:vn:o:";
 #endif /* ENABLE_GENDERS */
 
         static const struct option long_opts [] = {
@@ -614,6 +1548,12 @@ int main(int argc, char **argv)
 	   {"num-levels", 'n', 0, 1},
 	   {"node-name-map", 1, 0, 1},
 	   {"hosts", 1, 0, 2},
+	   {"load-cache", 1, 0, 3},
+	   {"output", 1, 0, 'o'},
+	   {"watch", 1, 0, 4},
+	   {"on-change", 1, 0, 5},
+	   {"link-speed", 0, 0, 6},
+	   {"stats", 0, 0, 7},
 #ifdef ENABLE_GENDERS
 	   {"genders", 'g', 0, 1},
 	   {"genders-query", 'q', 0, 1},
@@ -638,6 +1578,29 @@ int main(int argc, char **argv)
 			case 2:
 				expected_hosts = strdup(optarg);
 				break;
+			case 3:
+				load_cache_file = strdup(optarg);
+				break;
+			case 'o':
+				add_output(optarg);
+				break;
+			case 4:
+				watch_interval = atoi(optarg);
+				if (watch_interval < 0) {
+					fprintf(stderr, "invalid --watch "
+						"interval: %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 5:
+				on_change_cmd = strdup(optarg);
+				break;
+			case 6:
+				g_link_speed = 1;
+				break;
+			case 7:
+				stats_enable();
+				break;
 			case 'n':
 				g_num_levels = atoi(optarg);
 				break;
@@ -664,19 +1627,48 @@ int main(int argc, char **argv)
                 }
 	}
 
+	if (!num_outputs) {
+		if (watch_interval >= 0) {
+			fprintf(stderr, "--watch requires --output <file>\n");
+			exit(1);
+		}
+		add_output("-");
+	}
+
+	for (i = 0; i < num_outputs; i++) {
+		if (watch_interval >= 0 && strcmp(outputs[i].file, "-") == 0) {
+			fprintf(stderr, "--watch can not write to stdout\n");
+			exit(1);
+		}
+	}
+
 	if (ibd_timeout)
 		config.timeout_ms = ibd_timeout;
 
 	load_expected_host_list();
-	node_name_map = open_node_name_map(node_name_map_file);
+	node_name_map = nnmap_open(node_name_map_file);
 
-	fabric = ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL, &config);
+	if (watch_interval >= 0) {
+		rc = watch_fabric(ibd_ca, ibd_ca_port, &config);
+		goto close;
+	}
+
+	if ((fabric = load_fabric(ibd_ca, ibd_ca_port, &config)) == NULL) {
+		rc = -1;
+		goto close;
+	}
 
 	process_fabric(fabric);
 
+	/* the outputs read the nodes, so the fabric is kept until written */
+	if (write_outputs(0))
+		rc = -1;
 	ibnd_destroy_fabric(fabric);
+	done_with_fabric();
+	stats_report(stderr);
 
-	close_node_name_map(node_name_map);
+close:
+	nnmap_close(node_name_map);
 	destroy_expected_host_list();
 	exit(rc);
 }
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "stats.h"
+
+#define STATS_MAX_PHASES 16
+#define STATS_MAX_DEPTH 8
+#define STATS_MAX_COUNTERS 16
+
+typedef struct stats_phase {
+	const char *name;
+	double secs;
+	long heap;		/* change in bytes of heap in use */
+	unsigned long calls;
+} stats_phase_t;
+
+typedef struct stats_counter {
+	const char *name;
+	unsigned long val;
+} stats_counter_t;
+
+static int enabled = 0;
+static stats_phase_t phases[STATS_MAX_PHASES];
+static int num_phases = 0;
+static int stack[STATS_MAX_DEPTH];
+static int depth = 0;
+static int overflow = 0;	/* pushes past STATS_MAX_DEPTH */
+static stats_counter_t counters[STATS_MAX_COUNTERS];
+static int num_counters = 0;
+
+/* time and heap in use when the innermost phase was last charged */
+static double mark_secs = 0;
+static long mark_heap = 0;
+
+/** =========================================================================
+ * The heap in use, from glibc's malloc statistics.  This covers the
+ * libraries (libibnetdisc in particular) as well as our own code without
+ * replacing the allocator.
+ */
+#ifdef __GLIBC__
+#define STATS_HAVE_HEAP 1
+static long
+heap_in_use(void)
+{
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+#else
+	struct mallinfo mi = mallinfo();
+#endif
+
+	/* small allocations plus those given their own mapping */
+	return ((long)mi.uordblks + (long)mi.hblkhd);
+}
+#else
+static long
+heap_in_use(void)
+{
+	return (0);
+}
+#endif /* __GLIBC__ */
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+/* charge everything since the last mark to the innermost phase */
+static void
+charge(void)
+{
+	double t = now();
+	long heap = heap_in_use();
+
+	if (depth) {
+		stats_phase_t *p = &phases[stack[depth - 1]];
+		p->secs += t - mark_secs;
+		p->heap += heap - mark_heap;
+	}
+	mark_secs = t;
+	mark_heap = heap;
+}
+
+void
+stats_enable(void)
+{
+	enabled = 1;
+}
+
+int
+stats_enabled(void)
+{
+	return (enabled);
+}
+
+void
+stats_push(const char *phase)
+{
+	int i;
+
+	if (!enabled)
+		return;
+
+	charge();
+	for (i = 0; i < num_phases; i++)
+		if (phases[i].name == phase || strcmp(phases[i].name, phase) == 0)
+			break;
+	if (i == num_phases) {
+		if (num_phases == STATS_MAX_PHASES)
+			i = num_phases - 1; /* lump the rest in to the last */
+		else
+			phases[num_phases++].name = phase;
+	}
+	phases[i].calls++;
+
+	/* too deep; keep charging the caller's phase and count the level so
+	 * its pop does not end the caller's */
+	if (depth == STATS_MAX_DEPTH) {
+		overflow++;
+		return;
+	}
+	stack[depth++] = i;
+}
+
+void
+stats_pop(void)
+{
+	if (!enabled || !depth)
+		return;
+
+	charge();
+	if (overflow)
+		overflow--;
+	else
+		depth--;
+}
+
+void
+stats_set(const char *counter, unsigned long val)
+{
+	int i;
+
+	if (!enabled)
+		return;
+
+	for (i = 0; i < num_counters; i++)
+		if (strcmp(counters[i].name, counter) == 0)
+			break;
+	if (i == num_counters) {
+		if (num_counters == STATS_MAX_COUNTERS)
+			return;
+		counters[num_counters++].name = counter;
+	}
+	counters[i].val = val;
+}
+
+void
+stats_fabric(ibnd_fabric_t *fabric)
+{
+	ibnd_node_t *node;
+	unsigned long nodes = 0, ports = 0, ends = 0;
+	int p;
+
+	if (!enabled)
+		return;
+
+	for (node = fabric->nodes; node; node = node->next) {
+		nodes++;
+		for (p = 0; p <= node->numports; p++) {
+			if (!node->ports[p])
+				continue;
+			ports++;
+			if (node->ports[p]->remoteport)
+				ends++;
+		}
+	}
+	stats_set("nodes", nodes);
+	stats_set("ports", ports);
+	stats_set("links", ends / 2);
+}
+
+void
+stats_report(FILE *fp)
+{
+	double total_secs = 0;
+	long total_heap = 0;
+	int i;
+
+	if (!enabled)
+		return;
+
+	charge();
+
+	fprintf(fp, "stats: %-16s %12s %10s %8s\n",
+		"phase", "seconds", "heap KB", "calls");
+	for (i = 0; i < num_phases; i++) {
+		stats_phase_t *p = &phases[i];
+#ifdef STATS_HAVE_HEAP
+		fprintf(fp, "stats: %-16s %12.6f %+10ld %8lu\n",
+			p->name, p->secs, p->heap / 1024, p->calls);
+#else
+		fprintf(fp, "stats: %-16s %12.6f %10s %8lu\n",
+			p->name, p->secs, "-", p->calls);
+#endif
+		total_secs += p->secs;
+		total_heap += p->heap;
+	}
+#ifdef STATS_HAVE_HEAP
+	fprintf(fp, "stats: %-16s %12.6f %+10ld\n", "total",
+		total_secs, total_heap / 1024);
+#else
+	fprintf(fp, "stats: %-16s %12.6f %10s\n", "total", total_secs, "-");
+#endif
+	for (i = 0; i < num_counters; i++)
+		fprintf(fp, "stats: %-16s %12lu\n", counters[i].name,
+			counters[i].val);
+
+	/* phases still open carry on in to the next report */
+	for (i = 0; i < num_phases; i++) {
+		phases[i].secs = 0;
+		phases[i].heap = 0;
+		phases[i].calls = 0;
+	}
+	num_counters = 0;
+}
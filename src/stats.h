@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+#include <infiniband/ibnetdisc.h>
+
+/* --stats: wall time and change in heap in use of each phase of a run.
+ *
+ * Phases nest; time and heap are charged to the innermost phase so
+ * work such as name lookups can be separated from the pass which calls
+ * it.  Everything here is a no-op until stats_enable() is called.
+ */
+
+void stats_enable(void);
+int stats_enabled(void);
+
+/* enter/leave the phase named (a string constant) */
+void stats_push(const char *phase);
+void stats_pop(void);
+
+/* set a named count reported with the phases */
+void stats_set(const char *counter, unsigned long val);
+
+/* set the node, port and link counts from fabric */
+void stats_fabric(ibnd_fabric_t *fabric);
+
+/* print everything recorded since the last report to fp and reset */
+void stats_report(FILE *fp);
+
+#endif /* _STATS_H */
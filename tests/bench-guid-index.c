@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2011 Lawrence Livermore National Security
+ * Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ * UCRL-CODE-235440
+ * 
+ * This file is part of pragmatic-infiniband-tools (PIU), useful tools to manage
+ * Infiniband Clusters.
+ * For details, see http://www.llnl.gov/linux/.
+ * 
+ * PIU is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ * 
+ * PIU is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along with
+ * PIU; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ *
+ */
+
+/*
+ * bench-guid-index: time guid_index inserts and lookups from 1K to 100K
+ * GUIDs, the range of node counts of the fabrics it indexes.  Each size is
+ * run with GUIDs numbered densely from one vendor OUI, as a fabric's are,
+ * and with random GUIDs.  Lookups are repeated to at least 1M per size so
+ * the small tables are timed as well as the large ones.
+ *
+ * Run by "make bench".
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif				/* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "../src/guid_index.h"
+
+#define MIN_LOOKUPS 1000000
+
+static const unsigned sizes[] = { 1000, 2000, 5000, 10000, 20000, 50000,
+	100000 };
+
+static double now_secs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+/* xorshift64; the same sequence every run */
+static uint64_t rand64(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return (*state);
+}
+
+static void fill_guids(uint64_t *guids, unsigned n, int rand_guids)
+{
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		guids[i] = rand_guids ? rand64(&state) | 1
+				  : 0x0002c90300000000ULL + i;
+}
+
+/* ns per operation of inserting n GUIDs, looking them up and looking up n
+ * GUIDs that are not there */
+static int bench(unsigned n, int rand_guids)
+{
+	uint64_t *guids = malloc(2 * n * sizeof(*guids));
+	guid_index_t *gi;
+	unsigned i, passes, pass;
+	double start, insert, hit, miss;
+	int64_t sum = 0;
+
+	if (!guids || !(gi = guid_index_create(n))) {
+		fprintf(stderr, "ERROR: failed to allocate %u GUIDs\n", n);
+		return (-1);
+	}
+	/* the second half, never inserted, are the misses */
+	fill_guids(guids, 2 * n, rand_guids);
+	passes = (MIN_LOOKUPS + n - 1) / n;
+
+	start = now_secs();
+	for (i = 0; i < n; i++)
+		if (guid_index_insert(gi, guids[i], i)) {
+			fprintf(stderr, "ERROR: failed to insert GUID\n");
+			return (-1);
+		}
+	insert = now_secs() - start;
+
+	start = now_secs();
+	for (pass = 0; pass < passes; pass++)
+		for (i = 0; i < n; i++)
+			sum += guid_index_lookup(gi, guids[i]);
+	hit = now_secs() - start;
+
+	start = now_secs();
+	for (pass = 0; pass < passes; pass++)
+		for (i = n; i < 2 * n; i++)
+			sum += guid_index_lookup(gi, guids[i]);
+	miss = now_secs() - start;
+
+	/* every hit returns its position; every miss -1 */
+	if (sum != passes * ((int64_t)n * (n - 1) / 2 - n)) {
+		fprintf(stderr, "ERROR: %u %s GUIDs: wrong lookup result\n",
+			n, rand_guids ? "random" : "dense");
+		return (-1);
+	}
+
+	printf("%-8s %8u %12.1f %12.1f %12.1f\n",
+	       rand_guids ? "random" : "dense", n, insert * 1e9 / n,
+	       hit * 1e9 / ((double)passes * n),
+	       miss * 1e9 / ((double)passes * n));
+	guid_index_destroy(gi);
+	free(guids);
+	return (0);
+}
+
+int main(void)
+{
+	unsigned i;
+	int rand_guids, rc = 0;
+
+	printf("%-8s %8s %12s %12s %12s\n", "guids", "count", "insert ns",
+	       "hit ns", "miss ns");
+	for (rand_guids = 0; rand_guids < 2; rand_guids++)
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+			if (bench(sizes[i], rand_guids))
+				rc = 1;
+	return (rc);
+}
@@ -0,0 +1,90 @@
+#!/bin/bash
+#
+# Run slurm_topology --load-cache over the cache files in the fixture
+# directory and compare its output with the expected output kept there.
+#
+# The fixtures were written by scripts/ibfabricgen.pl:
+#    ibfabricgen.pl -t ftree:2,3 -o ftree.cache -m ftree.map
+#    ibfabricgen.pl -t tapered:4,4,2,2 -l 12xDDR -p host -o tapered.cache -m tapered.map
+#
+# A cache from a real fabric ("ibnetdiscover --cache <fabric>.cache", with an
+# optional <fabric>.map) is added with its cases below and recorded with -r.
+#
+
+bin_dir=src
+fixture_dir=`dirname $0`/load-cache
+regen=0
+
+# <fabric> <case> <slurm_topology options>; the fabric's cache file and node
+# name map, if it has one, are added to every case
+cases="
+ftree		tree		--hosts node[1-8]
+ftree		levels		--hosts node[1-8] -n 2
+ftree		block		--hosts node[1-8] -o slurm-block:-
+ftree		json		--hosts node[1-8] -o json:-
+ftree		hostfile	--hosts node[1-8] -o hostfile:-
+tapered		tree		--hosts host[1-16]
+tapered		missing		--hosts host[1-17]
+tapered		speed		--hosts host[1-16] --link-speed
+"
+
+usage()
+{
+	echo "check-load-cache.sh [-h] [-r] [-b <bin_dir>] [-d <dir>]"
+	echo "   Check slurm_topology --load-cache against expected outputs."
+	echo "   -h display this help"
+	echo "   -r rewrite the expected outputs rather than checking them"
+	echo "   -b <bin_dir> directory holding slurm_topology (default: $bin_dir)"
+	echo "   -d <dir> fixture directory (default: $fixture_dir)"
+}
+
+while getopts "hrb:d:" opt; do
+	case $opt in
+		r) regen=1 ;;
+		b) bin_dir=$OPTARG ;;
+		d) fixture_dir=$OPTARG ;;
+		h) usage; exit 0 ;;
+		*) usage; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ ! -x $bin_dir/slurm_topology ]; then
+	echo "ERROR: $bin_dir/slurm_topology not found; build it first" 1>&2
+	exit 1
+fi
+
+out=`mktemp ${TMPDIR:-/tmp}/check-load-cache.XXXXXX` || exit 1
+trap "rm -f $out" EXIT
+
+rc=0
+while read fabric name args; do
+	if [ "$fabric" == "" ]; then
+		continue
+	fi
+	base=$fixture_dir/$fabric
+	expected=$base.$name.out
+	map=
+	if [ -f $base.map ]; then
+		map="--node-name-map $base.map"
+	fi
+
+	# the header carries the time of the run
+	$bin_dir/slurm_topology --load-cache $base.cache $map $args \
+		2> /dev/null \
+		| grep -v '^# Slurm .*Topology ' > $out
+	if [ ${PIPESTATUS[0]} != 0 ]; then
+		echo "FAIL: $fabric $name: slurm_topology $args exited non-zero"
+		rc=1
+	elif [ $regen == 1 ]; then
+		cat $out > $expected
+		echo "WROTE: $expected"
+	elif ! diff -u $expected $out; then
+		echo "FAIL: $fabric $name: slurm_topology $args"
+		rc=1
+	else
+		echo "PASS: $fabric $name"
+	fi
+done <<< "$cases"
+
+exit $rc